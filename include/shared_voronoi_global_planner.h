@@ -4,6 +4,7 @@
 #include <map_msgs/OccupancyGridUpdate.h>
 #include <costmap_2d/costmap_2d_ros.h>
 #include <costmap_2d/costmap_2d.h>
+#include <costmap_2d/cost_values.h>
 #include <nav_core/base_global_planner.h>
 #include <geometry_msgs/PoseStamped.h>
 #include <geometry_msgs/Twist.h>
@@ -32,12 +33,13 @@ namespace shared_voronoi_global_planner
 
     private:
         /**
-         * Internal copy of local costmap from ROS
+         * Latest local costmap message from ROS, held by reference instead of being copied. Composited on top of the
+         * global costmap as the overlay of map
          **/
-        nav_msgs::OccupancyGrid local_costmap;
+        nav_msgs::OccupancyGrid::ConstPtr local_costmap;
 
         /** 
-         * Internal map which merges global and local costmap from ros
+         * Internal map of the global costmap from ros, with the local costmap as its overlay
          **/
         voronoi_path::Map map;
 
@@ -111,10 +113,49 @@ namespace shared_voronoi_global_planner
         int pixels_to_skip = 0;
 
         /**
-         * Downscale factor used for scaling map before finding contours. Smaller values increase speed (possibly marginal)
-         * but may decrease the accuracy of the centroids found
+         * Only use occupied pixels bordering free space as voronoi sites
          **/
-        double open_cv_scale = 0.25;
+        bool boundary_sites = false;
+
+        /**
+         * Maximum distance (m) between an occupied cell and the voronoi site representing it, 0 disables decimation
+         **/
+        double site_tolerance = 0;
+
+        /**
+         * Obstacles with a bounding box smaller than this area (m^2) are ignored for homotopy classes
+         **/
+        double min_obstacle_area = 0;
+
+        /**
+         * Also ignore insignificant obstacles when generating the voronoi diagram
+         **/
+        bool filter_obstacle_sites = false;
+
+        /**
+         * Use bit-packed threshold planes of the map instead of cost bytes when finding occupied cells and checking collisions
+         **/
+        bool use_bitplanes = true;
+
+        /**
+         * Margin (m) around start and goal of the window the voronoi graph is built in, 0 builds it over the whole map
+         **/
+        double roi_margin = 0;
+
+        /**
+         * Number of downsampled voronoi graphs used for coarse-to-fine planning, 0 plans on the full resolution graph only
+         **/
+        int coarse_levels = 0;
+
+        /**
+         * Number of threads used by the voronoi_path object's parallel stages, 0 uses the number of cores
+         **/
+        int num_threads = 0;
+
+        /**
+         * Distance (m) from a coarse route within which the finer graph is searched during coarse-to-fine planning
+         **/
+        double corridor_radius = 1.0;
 
         /**
          * Threshold to classify a homotopy class as same or different. Ideally, same homotopy classes should have identical 
@@ -122,6 +163,27 @@ namespace shared_voronoi_global_planner
          **/
         double h_class_threshold = 0.2;
 
+        /**
+         * Compare homotopy classes by integer winding numbers around obstacles instead of the H-signature
+         **/
+        bool use_winding_numbers = true;
+
+        /**
+         * Derive homotopy classes of graph paths from the faces of the Voronoi graph instead of obstacle branch cuts
+         **/
+        bool use_face_classes = false;
+
+        /**
+         * Find paths of distinct homotopy classes with a single search over (node, class) states instead of Yen's algorithm
+         **/
+        bool use_homotopy_search = false;
+
+        /**
+         * Only obstacles in an ellipse around start and goal are used for homotopy classes, sized as a ratio of their distance.
+         * 0 uses all obstacles, values in (0, 1) are raised to 1
+         **/
+        double homotopy_corridor_ratio = 0;
+
         /**
          * Minimum separation between nodes. If nodes are less than this value (m^2) apart, they will be cleaned up
          **/
@@ -218,6 +280,11 @@ namespace shared_voronoi_global_planner
          * Parameter to set whether global map is static (no mapping is being run)
          **/
         bool static_global_map = true;
+
+        /**
+         * Read the global costmap directly from the Costmap2DROS given to initialize() instead of subscribing to costmap topics
+         **/
+        bool use_costmap_ros = false;
         
         /**
          * Minimum distance between poses on global path generated
@@ -251,10 +318,19 @@ namespace shared_voronoi_global_planner
         std::vector<std::pair<double, int>> sorted_nodes_raw;
         
         /**
-         * Internal store of pixels that were modified during the last local costmap callback, used to restore the pixels in the following 
-         * time step when a new callback is called
+         * Global costmap passed in by move_base during initialization, used when use_costmap_ros is set
+         **/
+        costmap_2d::Costmap2DROS *costmap_ros_ = nullptr;
+
+        /**
+         * Lookup table to translate Costmap2D costs into OccupancyGrid values, same translation as costmap_2d's publisher
+         **/
+        signed char cost_translation_table[256];
+
+        /**
+         * Mutex guarding map against costmap callbacks while it is being read for voronoi generation or planning
          **/
-        std::vector<std::pair<int, int>> map_pixels_backup;
+        std::mutex map_mtx;
 
         //ROS variables
         ros::NodeHandle nh;
@@ -308,6 +384,24 @@ namespace shared_voronoi_global_planner
          **/
         void globalCostmapUpdateCB(const map_msgs::OccupancyGridUpdate::ConstPtr &msg);
 
+        /**
+         * Copy the global costmap from costmap_ros_ into the internal map under the costmap's lock. Only cells whose
+         * value changed are written, and their bounding region is marked dirty
+         * @return boolean indicating whether the costmap could be read
+         **/
+        bool readCostmapROS();
+
+        /**
+         * Get the region covered by the local costmap, in global costmap pixels
+         * @return rectangle covered by local costmap, empty if either costmap has not been received
+         **/
+        voronoi_path::MapRect getLocalCostmapRect();
+
+        /**
+         * Place the latest local costmap as the overlay of the internal map, at its position in the global costmap
+         **/
+        void updateLocalCostmapOverlay();
+
         /**
          * Callback for Twist from joystick which indicates user direction
          **/
@@ -354,6 +448,11 @@ namespace shared_voronoi_global_planner
          **/
         bool joystickExceedsThreshold(const geometry_msgs::Twist & cmd_vel, const double max_lin_command, const double max_ang_command, const double magnitude_threshold);
 
+        /**
+         * Publish adjacency list and node info of the voronoi graph, and its visualization markers if visualize_edges is set
+         **/
+        void publishVoronoiGraph();
+
         /**
          * Publish visualization markers for generated voronoi graph
          **/
@@ -0,0 +1,216 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed size pool of worker threads with one task queue per worker. Workers take tasks from the back of their own queue
+ * and steal from the front of other queues when theirs is empty. Threads waiting on parallelFor run queued tasks instead
+ * of blocking, so parallelFor can be nested and called from workers
+ **/
+class ThreadPool
+{
+public:
+    /**
+     * @param num_threads number of threads that run tasks, including the thread calling parallelFor. 0 uses the number of cores
+     **/
+    explicit ThreadPool(int num_threads = 0)
+    {
+        if (num_threads <= 0)
+            num_threads = std::max(1u, std::thread::hardware_concurrency());
+
+        num_threads_ = num_threads;
+
+        //Last queue takes tasks submitted from threads outside of the pool
+        for (int i = 0; i < num_threads_; ++i)
+            queues.emplace_back(new TaskQueue());
+
+        for (int i = 0; i < num_threads_ - 1; ++i)
+            workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(wake_mtx);
+            stopping = true;
+        }
+
+        wake_cv.notify_all();
+        for (auto &worker : workers)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /**
+     * Number of threads that run tasks, including the calling thread
+     **/
+    int size() const
+    {
+        return num_threads_;
+    }
+
+    /**
+     * Call func(i) for every i in [begin, end), one task per index, and return once all calls finished. The calling thread
+     * runs tasks as well. If any call throws, the first exception is rethrown after all calls finished
+     **/
+    void parallelFor(int begin, int end, const std::function<void(int)> &func)
+    {
+        if (end <= begin)
+            return;
+
+        std::atomic<int> remaining(end - begin);
+        std::exception_ptr error;
+        std::mutex error_mtx;
+        auto run = [&](int i) {
+            try
+            {
+                func(i);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(error_mtx);
+                if (!error)
+                    error = std::current_exception();
+            }
+
+            --remaining;
+        };
+
+        for (int i = begin + 1; i < end; ++i)
+            submit([&run, i]() { run(i); });
+
+        run(begin);
+
+        //Help with queued tasks instead of blocking, tasks of this call may be sitting in any queue
+        int self = threadIndex();
+        while (remaining > 0)
+        {
+            if (!runTask(self))
+                std::this_thread::yield();
+        }
+
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+private:
+    struct TaskQueue
+    {
+        std::mutex mtx;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    int num_threads_;
+    std::vector<std::unique_ptr<TaskQueue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex wake_mtx;
+    std::condition_variable wake_cv;
+    std::atomic<int> pending{0};
+    bool stopping = false;
+
+    std::atomic<unsigned int> next_queue{0};
+
+    /**
+     * Index of the calling thread's queue, the shared queue for threads outside of this pool
+     **/
+    int threadIndex()
+    {
+        const ThreadPool *&owner = threadOwner();
+        return owner == this ? threadQueue() : num_threads_ - 1;
+    }
+
+    static const ThreadPool *&threadOwner()
+    {
+        static thread_local const ThreadPool *owner = nullptr;
+        return owner;
+    }
+
+    static int &threadQueue()
+    {
+        static thread_local int queue = -1;
+        return queue;
+    }
+
+    void submit(std::function<void()> task)
+    {
+        //Workers push to their own queue, other threads spread tasks over all queues
+        int queue = threadOwner() == this ? threadQueue() : next_queue++ % num_threads_;
+        {
+            std::lock_guard<std::mutex> lock(queues[queue]->mtx);
+            queues[queue]->tasks.push_back(std::move(task));
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(wake_mtx);
+            ++pending;
+        }
+
+        wake_cv.notify_one();
+    }
+
+    /**
+     * Run one task, newest from own queue first, otherwise oldest stolen from another queue
+     * @return false if all queues were empty
+     **/
+    bool runTask(int self)
+    {
+        std::function<void()> task;
+        for (int i = 0; i < num_threads_ && !task; ++i)
+        {
+            int queue = (self + i) % num_threads_;
+            std::lock_guard<std::mutex> lock(queues[queue]->mtx);
+            std::deque<std::function<void()>> &tasks = queues[queue]->tasks;
+            if (tasks.empty())
+                continue;
+
+            if (i == 0)
+            {
+                task = std::move(tasks.back());
+                tasks.pop_back();
+            }
+
+            else
+            {
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+        }
+
+        if (!task)
+            return false;
+
+        --pending;
+        task();
+        return true;
+    }
+
+    void workerLoop(int index)
+    {
+        threadOwner() = this;
+        threadQueue() = index;
+        while (true)
+        {
+            if (runTask(index))
+                continue;
+
+            std::unique_lock<std::mutex> lock(wake_mtx);
+            wake_cv.wait(lock, [this]() { return stopping || pending > 0; });
+            if (stopping)
+                return;
+        }
+    }
+};
+
+#endif
@@ -11,19 +11,19 @@
 #define JCV_PI 3.141592653589793115997963468544185161590576171875
 
 #include "jc_voronoi_clip.h"
+#include "thread_pool.h"
 #include <chrono>
+#include <algorithm>
 #include <limits>
 #include <cmath>
 #include <vector>
 #include <string>
 #include <map>
+#include <unordered_map>
 #include <complex>
 #include <mutex>
 #include <memory>
 
-#include <opencv2/highgui.hpp>
-#include <opencv2/opencv.hpp>
-
 namespace voronoi_path
 {
     /**
@@ -92,6 +92,95 @@ namespace voronoi_path
         }
     };
 
+    /**
+     * Homotopy class of a path. h_signature is the complex H-signature. windings holds the number of times the path, closed by
+     * a straight line from its end back to its start, winds around each obstacle as (obstacle ID, winding) pairs sorted by ID,
+     * obstacles that are not wound around are left out. Paths with the same start and end are of the same class exactly when
+     * their windings are equal, their H-signatures are equal as well but distinct classes can have close H-signatures
+     **/
+    struct HomotopyClass
+    {
+        std::complex<double> h_signature;
+        std::vector<std::pair<uint32_t, int>> windings;
+    };
+
+    /**
+     * Key of a homotopy class in HomotopyRegistry, either its winding numbers or its H-signature rounded to a grid
+     **/
+    struct HomotopySignature
+    {
+        int64_t real = 0;
+        int64_t imag = 0;
+        std::vector<std::pair<uint32_t, int>> windings;
+
+        bool operator==(const HomotopySignature &rhs) const
+        {
+            return real == rhs.real && imag == rhs.imag && windings == rhs.windings;
+        }
+    };
+
+    struct HomotopySignatureHash
+    {
+        size_t operator()(const HomotopySignature &signature) const
+        {
+            //FNV-1a over the grid cell and winding numbers
+            const uint64_t prime = 1099511628211ULL;
+            uint64_t signature_hash = 14695981039346656037ULL;
+            signature_hash = (signature_hash ^ static_cast<uint64_t>(signature.real)) * prime;
+            signature_hash = (signature_hash ^ static_cast<uint64_t>(signature.imag)) * prime;
+            for (const auto &winding : signature.windings)
+                signature_hash = (signature_hash ^ ((static_cast<uint64_t>(winding.first) << 32) | static_cast<uint32_t>(winding.second))) * prime;
+
+            return signature_hash ^ (signature_hash >> 32);
+        }
+    };
+
+    /**
+     * Homotopy classes found so far with the best path of each, so that checking whether a class is new takes constant time.
+     * Classes are keyed by their winding numbers, which is exact. Without use_windings, H-signatures are rounded to a grid
+     * with a spacing of threshold times the magnitude of the first signature seen instead, which can merge distinct classes
+     * with close signatures. Only classes of paths with the same start and end should be registered together
+     **/
+    class HomotopyRegistry
+    {
+    public:
+        HomotopyRegistry(bool _use_windings, double _threshold) : use_windings(_use_windings), threshold(_threshold) {}
+
+        /**
+         * Key of a homotopy class, the first call fixes the grid
+         **/
+        HomotopySignature signature(const HomotopyClass &h_class);
+
+        /**
+         * Check whether a path of this class was registered
+         **/
+        bool contains(const HomotopyClass &h_class);
+
+        /**
+         * Register path as the best path of its class if the class is new or cost is lower than the registered path's
+         * @param h_class class of path
+         * @param path index of the path, meaning is up to the caller
+         * @param cost cost of the path
+         * @return true if the class was new
+         **/
+        bool insert(const HomotopyClass &h_class, int path, double cost);
+
+        size_t size() const
+        {
+            return classes.size();
+        }
+
+    private:
+        bool use_windings;
+        double threshold;
+        double step = 0;
+
+        /**
+         * (cost, index) of the best path of each class
+         **/
+        std::unordered_map<HomotopySignature, std::pair<double, int>, HomotopySignatureHash> classes;
+    };
+
     /**
      * Struct to store vector of GraphNodes (a path) and its corresponding id
      **/
@@ -100,6 +189,12 @@ namespace voronoi_path
         uint32_t id;
         std::vector<GraphNode> path;
 
+        /**
+         * Homotopy class of the path, only valid if has_h_class is set. Kept up to date when obstacles are added or removed
+         **/
+        HomotopyClass h_class;
+        bool has_h_class = false;
+
         //Constructors
         Path() : id(-1){}
         Path(uint32_t _id, std::vector<GraphNode> && in_path)
@@ -109,17 +204,107 @@ namespace voronoi_path
         }
     };
 
+    /**
+     * Axis aligned rectangle of map cells. (x, y) is the first cell of the rectangle, same convention as map_msgs::OccupancyGridUpdate
+     **/
+    struct MapRect
+    {
+        int x;
+        int y;
+        int width;
+        int height;
+
+        MapRect() : x(0), y(0), width(0), height(0) {}
+        MapRect(int _x, int _y, int _width, int _height) : x(_x), y(_y), width(_width), height(_height) {}
+
+        bool empty() const
+        {
+            return width <= 0 || height <= 0;
+        }
+
+        bool contains(int _x, int _y) const
+        {
+            return _x >= x && _x < x + width && _y >= y && _y < y + height;
+        }
+
+        bool contains(const MapRect &rhs) const
+        {
+            return rhs.x >= x && rhs.y >= y && rhs.x + rhs.width <= x + width && rhs.y + rhs.height <= y + height;
+        }
+
+        bool operator==(const MapRect &rhs) const
+        {
+            return x == rhs.x && y == rhs.y && width == rhs.width && height == rhs.height;
+        }
+
+        bool operator!=(const MapRect &rhs) const
+        {
+            return !(*this == rhs);
+        }
+
+        bool intersects(const MapRect &rhs) const
+        {
+            return !intersect(rhs).empty();
+        }
+
+        MapRect intersect(const MapRect &rhs) const
+        {
+            int x0 = std::max(x, rhs.x);
+            int y0 = std::max(y, rhs.y);
+            int x1 = std::min(x + width, rhs.x + rhs.width);
+            int y1 = std::min(y + height, rhs.y + rhs.height);
+            if (x1 <= x0 || y1 <= y0)
+                return MapRect();
+
+            return MapRect(x0, y0, x1 - x0, y1 - y0);
+        }
+
+        /**
+         * Smallest rectangle containing both rectangles, empty rectangles are ignored
+         **/
+        MapRect unite(const MapRect &rhs) const
+        {
+            if (empty())
+                return rhs;
+
+            if (rhs.empty())
+                return *this;
+
+            int x0 = std::min(x, rhs.x);
+            int y0 = std::min(y, rhs.y);
+            int x1 = std::max(x + width, rhs.x + rhs.width);
+            int y1 = std::max(y + height, rhs.y + rhs.height);
+            return MapRect(x0, y0, x1 - x0, y1 - y0);
+        }
+    };
+
     /**
      * Same structure as ROS's nav_msgs::OccupancyGrid type
      * Redefined here to decouple from ROS
      **/
     struct Map
     {
+        /**
+         * Max number of dirty rectangles stored before they are merged into a single bounding rectangle
+         **/
+        static const int MAX_DIRTY_RECTS = 32;
+
+        /**
+         * Owned cell storage, only used when the map is not a view into a buffer owned by someone else
+         **/
         std::vector<signed char> data;
+
+        /**
+         * Non-owning view into cells stored elsewhere (eg. a ROS message), view_owner keeps the buffer alive while it is viewed
+         **/
+        const signed char *view_data = nullptr;
+        size_t view_size = 0;
+        std::shared_ptr<const void> view_owner;
+
         std::string frame_id;
-        double resolution;
-        int width;
-        int height;
+        double resolution = 0;
+        int width = 0;
+        int height = 0;
         struct
         {
             struct
@@ -138,6 +323,23 @@ namespace voronoi_path
             } orientation;
         } origin;
 
+        /**
+         * Layer composited on top of the map cells (eg. the local costmap), with its own origin and size in map cells.
+         * Overlay cells with values >= threshold replace the map cell, other overlay cells are transparent
+         **/
+        struct
+        {
+            MapRect rect;
+            const signed char *data = nullptr;
+            std::shared_ptr<const void> owner;
+            int threshold = 0;
+        } overlay;
+
+        /**
+         * Regions of the map that were modified since dirty rectangles were last cleared
+         **/
+        std::vector<MapRect> dirty_rects;
+
         Map() {}
         Map(std::vector<int> in_data, int _width, int _height, double _resolution, std::string _frame_id)
         {
@@ -147,6 +349,173 @@ namespace voronoi_path
             resolution = _resolution;
             frame_id = _frame_id;
         }
+
+        /**
+         * Read only access to cells, regardless of whether they are owned or viewed
+         * @return pointer to the first cell, row major
+         **/
+        const signed char *cells() const
+        {
+            return view_data ? view_data : data.data();
+        }
+
+        /**
+         * Number of cells in the map
+         **/
+        size_t size() const
+        {
+            return view_data ? view_size : data.size();
+        }
+
+        bool empty() const
+        {
+            return size() == 0;
+        }
+
+        /**
+         * Use cells stored elsewhere without copying them. Any owned cells are released
+         * @param in_data pointer to the first cell, row major
+         * @param in_size number of cells
+         * @param owner handle keeping in_data alive, held until the view is replaced or detached
+         **/
+        void setView(const signed char *in_data, size_t in_size, std::shared_ptr<const void> owner)
+        {
+            std::vector<signed char>().swap(data);
+            view_data = in_data;
+            view_size = in_size;
+            view_owner = std::move(owner);
+        }
+
+        /**
+         * Cost of a cell with the overlay composited on top. Cell must lie inside the map
+         * @param x column of the cell
+         * @param y row of the cell
+         * @return cost of the cell
+         **/
+        signed char getCost(int x, int y) const
+        {
+            if (overlay.data && overlay.rect.contains(x, y))
+            {
+                signed char overlay_cost = overlay.data[(y - overlay.rect.y) * overlay.rect.width + x - overlay.rect.x];
+                if (overlay_cost >= overlay.threshold)
+                    return overlay_cost;
+            }
+
+            return cells()[y * width + x];
+        }
+
+        /**
+         * Composite a layer on top of the map without copying or modifying map cells. Replaces the previous overlay
+         * @param rect region covered by the overlay, in map cells. May extend outside of the map
+         * @param in_data row major overlay cells, rect.width * rect.height elements
+         * @param owner handle keeping in_data alive while the overlay is in use
+         * @param threshold overlay cells below this value do not affect the map
+         **/
+        void setOverlay(const MapRect &rect, const signed char *in_data, std::shared_ptr<const void> owner, int threshold)
+        {
+            markDirty(overlay.rect);
+            overlay.rect = rect;
+            overlay.data = in_data;
+            overlay.owner = std::move(owner);
+            overlay.threshold = threshold;
+            markDirty(overlay.rect);
+        }
+
+        /**
+         * Remove the overlay, if any
+         **/
+        void clearOverlay()
+        {
+            markDirty(overlay.rect);
+            overlay.rect = MapRect();
+            overlay.data = nullptr;
+            overlay.owner.reset();
+        }
+
+        /**
+         * Take ownership of cells, any current view is released
+         * @param in_data row major cells, width * height elements
+         **/
+        void setData(std::vector<signed char> &&in_data)
+        {
+            view_data = nullptr;
+            view_size = 0;
+            view_owner.reset();
+            data = std::move(in_data);
+        }
+
+        /**
+         * Writable access to cells. If the map is currently a view, the viewed cells are copied into owned storage
+         * first and the view is released (copy on write)
+         * @return pointer to the first cell, row major
+         **/
+        signed char *mutableCells()
+        {
+            if (view_data)
+            {
+                data.assign(view_data, view_data + view_size);
+                view_data = nullptr;
+                view_size = 0;
+                view_owner.reset();
+            }
+
+            return data.data();
+        }
+
+        /**
+         * Copy a patch of cells into the map at its offset, row by row. Parts of the patch outside the map are dropped
+         * and the region that was written is recorded as dirty
+         * @param rect position and size of the patch, in map cells
+         * @param patch_data row major cells of the patch, must contain rect.width * rect.height elements
+         * @return boolean indicating whether any cell was copied
+         **/
+        bool applyPatch(const MapRect &rect, const signed char *patch_data)
+        {
+            MapRect clipped = rect.intersect(MapRect(0, 0, width, height));
+            if (clipped.empty() || size() != static_cast<size_t>(width) * height)
+                return false;
+
+            signed char *dst = mutableCells();
+            for (int row = clipped.y; row < clipped.y + clipped.height; ++row)
+            {
+                const signed char *src = patch_data + (row - rect.y) * rect.width + (clipped.x - rect.x);
+                std::copy(src, src + clipped.width, dst + row * width + clipped.x);
+            }
+
+            markDirty(clipped);
+            return true;
+        }
+
+        /**
+         * Record a region of the map as modified
+         * @param rect region that was modified, in map cells
+         **/
+        void markDirty(const MapRect &rect)
+        {
+            MapRect clipped = rect.intersect(MapRect(0, 0, width, height));
+            if (clipped.empty())
+                return;
+
+            dirty_rects.push_back(clipped);
+
+            //Too many small regions, collapse them so consumers do not have to iterate a long list
+            if (dirty_rects.size() > MAX_DIRTY_RECTS)
+            {
+                MapRect bounds;
+                for (const auto &dirty : dirty_rects)
+                    bounds = bounds.unite(dirty);
+
+                dirty_rects.assign(1, bounds);
+            }
+        }
+
+        /**
+         * Clear all recorded dirty regions, called once the changes have been consumed
+         **/
+        void clearDirty()
+        {
+            dirty_rects.clear();
+        }
     };
 
     /**
@@ -198,12 +567,24 @@ namespace voronoi_path
         std::vector<double> getAllPathCosts();
 
         /**
-         * Gets voronoi graph from map_
+         * Gets voronoi graph from map_. Graph is only regenerated if the map content or local vertices changed since the previous call
          * @param map_ map to use for generation of voronoi graph
          * @return boolean indicating success
          **/
         bool mapToGraph(Map* map_ptr_);
 
+        /**
+         * Check whether the previous call to mapToGraph regenerated the graph
+         * @return false if the map was unchanged and the graph from before was kept
+         **/
+        bool isGraphUpdated();
+
+        /**
+         * Get the tiles of the map whose content changed during the previous call to mapToGraph
+         * @return regions of the changed tiles, in cells
+         **/
+        std::vector<MapRect> getChangedTiles();
+
         /**
          * Get adjacency list of the current voronoi graph
          * @return adjacency list
@@ -241,6 +622,27 @@ namespace voronoi_path
          **/
         std::vector<Path> replan(GraphNode &start, GraphNode &end, int num_paths, int &pref_path);
 
+        /**
+         * Paths of distinct homotopy classes through the full resolution graph between the nodes nearest to start and end,
+         * as Yen's algorithm or use_homotopy_search find them for getPath, before interpolation and contraction. Previous
+         * paths are left as they are
+         * @param start starting position
+         * @param end ending position
+         * @param num_paths number of paths to find
+         * @param costs filled with the graph cost of each path
+         * @return node positions of each path, shortest first
+         **/
+        std::vector<std::vector<GraphNode>> getGraphPaths(const GraphNode &start, const GraphNode &end, int num_paths, std::vector<double> &costs);
+
+        /**
+         * Set start and goal of the current plan. When roi_margin is set, mapToGraph only builds the graph within a window
+         * around both, the window is moved on the next call to mapToGraph
+         * @param start start position in pixels
+         * @param end goal position in pixels
+         * @return true if start or goal lie outside the window of the current graph, mapToGraph should be called before planning
+         **/
+        bool setRegionOfInterest(const GraphNode &start, const GraphNode &end);
+
         /**
          * Set the location of local vertices. Vertices are in pixels, in global map's frame
          * @param vertices vector containing the 4 corners of local costmap
@@ -267,6 +669,15 @@ namespace voronoi_path
          **/
         bool hasPreviousPaths();
 
+        /**
+         * Calculate the homotopy class, algorithm from paper "Search-Based Path Planning with Homotopy Class Constraints"
+         * by Subhrajit Bhattacharya et al https://www.cs.huji.ac.il/~jeff/aaai10/02/AAAI10-216.pdf
+         * Uses the obstacles of the current graph within the homotopy corridor of the last getPath call
+         * @param path_ path to calculate homotopy class
+         * @return H-signature and winding numbers of path_
+         **/
+        HomotopyClass calcHomotopyClass(const std::vector<GraphNode> &path_);
+
         /**
          * Pixel resolution to increment when checking if an edge collision occurs. Value of 0.1 means the edge will
          * be checked at every 0.1 pixel intervals
@@ -306,18 +717,82 @@ namespace voronoi_path
         int pixels_to_skip = 0;
 
         /**
-         * Downscale factor used for scaling map before finding contours. Smaller values increase speed (possibly marginal)
-         * but may decrease the accuracy of the centroids found
+         * Margin in meters added around start and goal to form the window the graph is built in, see setRegionOfInterest.
+         * 0 builds the graph over the whole map
+         **/
+        double roi_margin = 0;
+
+        /**
+         * Only use occupied pixels next to a free pixel (4-neighbourhood) as voronoi sites. Free space is closer to these pixels
+         * than to any pixel inside an obstacle, so the graph outside of obstacles is unchanged while thick obstacles produce
+         * far fewer sites and internal edges
+         **/
+        bool boundary_sites = false;
+
+        /**
+         * Maximum distance in meters between an occupied cell and the voronoi site representing it. The map is divided into
+         * square blocks with a diagonal of at most this distance and only the first site of every block is kept, so walls
+         * keep a site at least every 2 blocks instead of being skipped. Replaces pixels_to_skip when greater than 0
+         **/
+        double site_tolerance = 0;
+
+        /**
+         * Obstacles whose bounding box covers less than this area in m^2 are insignificant and ignored when calculating
+         * homotopy classes. Removes speckles that slow down homotopy calculations and split paths into classes that only
+         * differ by which side of a speckle they pass. 0 keeps all obstacles
+         **/
+        double min_obstacle_area = 0;
+
+        /**
+         * Also treat cells of insignificant obstacles as free when finding voronoi sites
+         **/
+        bool filter_obstacle_sites = false;
+
+        /**
+         * Number of threads used by parallel stages, including the calling thread. 0 uses the number of cores
+         **/
+        int num_threads = 0;
+
+        /**
+         * Use bit-packed threshold planes of the map when finding occupied cells, labelling obstacles and checking collisions,
+         * instead of comparing cost bytes. Results are the same either way, disabling is only useful for comparing timings
          **/
-        double open_cv_scale = 0.25;
+        bool use_bitplanes = true;
 
         /**
-         * Percentage threshold to classify a homotopy class as same or different. Ideally, same homotopy classes should have identical 
-         * complex values, but since "double" representation is used, some difference might be present for same homotopy classes
-         * 0.01 means 1 percent difference in class values
+         * Percentage threshold to classify a homotopy class as same or different when use_winding_numbers is not set. 0.01
+         * means 1 percent difference in class values. Used as the grid spacing of HomotopyRegistry, relative to the first class
          **/
         double h_class_threshold = 0.01;
 
+        /**
+         * Compare homotopy classes by the integer winding number around every obstacle instead of the H-signature. Winding
+         * numbers are compared exactly, do not depend on how many obstacles there are and ignore h_class_threshold. Enabled
+         * by default, H-signatures of distinct classes can lie within h_class_threshold of each other, see obstacleCoefficient
+         **/
+        bool use_winding_numbers = true;
+
+        /**
+         * Derive homotopy classes of graph paths from the faces of the planar graph instead of obstacle branch cuts. Each
+         * obstacle is assigned the bounded face around it and a cut from that face to the outer face through the dual graph,
+         * so windings are counts of the cut edges a path uses instead of winding numbers. Paths that left the graph, like
+         * replanned paths, still use calcHomotopyClass
+         **/
+        bool use_face_classes = false;
+
+        /**
+         * Find paths with a single best-first search over (node, homotopy class) states instead of Yen's k shortest paths with
+         * classes checked afterwards. The search is approximate, see findHomotopyPaths
+         **/
+        bool use_homotopy_search = false;
+
+        /**
+         * Only use obstacles inside an ellipse with the start and goal as foci for homotopy classes, the sum of distances to
+         * both foci is at most this times the distance between start and goal. Paths longer than that may leave the ellipse
+         * and be treated as the same class as a shorter path. 0 uses all obstacles, other values below 1 are used as 1
+         **/
+        double homotopy_corridor_ratio = 0;
+
         /**
          * Minimum separation between nodes. If nodes are less than this value (m) apart, they will be cleaned up
          **/
@@ -343,7 +818,161 @@ namespace voronoi_path
          **/
         double path_waypoint_sep = 0.2;
 
+        /**
+         * Number of downsampled graphs used for coarse-to-fine planning, each is 4x coarser than the one below it.
+         * Routes are found on the coarsest graph and refined level by level within a corridor. 0 plans on this graph only
+         **/
+        int coarse_levels = 0;
+
+        /**
+         * Distance (m) from a coarse route within which nodes of the finer graph are searched during refinement
+         **/
+        double corridor_radius = 1.0;
+
     private:
+        /**
+         * Downsampled copy of the planning window with its own voronoi graph, used for coarse-to-fine planning
+         **/
+        struct CoarseLevel
+        {
+            /**
+             * Max-pooled costs of the planning window, cell (x, y) covers scale x scale cells starting at
+             * (planning_window.x + x * scale, planning_window.y + y * scale)
+             **/
+            Map map;
+            std::unique_ptr<voronoi_path> graph;
+            int scale = 1;
+        };
+
+        /**
+         * Obstacle tracked across map updates. The ID is kept while the obstacle's first cell in row-major order stays the same
+         **/
+        struct Obstacle
+        {
+            uint32_t id = 0;
+
+            /**
+             * Center of the obstacle's first cell, used as its point for homotopy classes
+             **/
+            std::complex<double> point;
+
+            /**
+             * Bounding box of the obstacle's cells
+             **/
+            MapRect bounds;
+
+            /**
+             * Number of cells
+             **/
+            int area = 0;
+
+            /**
+             * Bounding box covers at least min_obstacle_area, only significant obstacles are used for homotopy classes
+             **/
+            bool significant = true;
+        };
+
+        /**
+         * Homotopy contribution of the directed edge to node, excluding the end point terms that telescope over a path.
+         * term is 2*pi*i times the sum of obstacle coefficients weighted by crossings of their branch cuts. Crossings are
+         * (center index, count) pairs edge_crossings[crossings_begin, crossings_end), multiplied by direction. With
+         * use_face_classes, cuts between faces replace branch cuts
+         **/
+        struct EdgeHomotopy
+        {
+            int node = -1;
+            std::complex<double> term;
+            int crossings_begin = 0;
+            int crossings_end = 0;
+            int direction = 1;
+        };
+
+        /**
+         * Face of the planar graph, traced with the face on the left of its edges. Bounded faces are counter-clockwise and
+         * have a positive area. Faces form a tree per connected component rooted at its outer face, parent shares the
+         * directed edge from edge_node to edge_next with this face on its left. boundary are the nodes around the face,
+         * consecutive nodes are joined by an edge or are the same vertex of the embedding
+         **/
+        struct GraphFace
+        {
+            double area = 0;
+            int parent = -1;
+            int edge_node = -1;
+            int edge_next = -1;
+            std::vector<int> boundary;
+        };
+
+        /**
+         * Horizontal run of obstacle cells [x0, x1) in row y
+         **/
+        struct ObstacleRun
+        {
+            int y;
+            int x0;
+            int x1;
+        };
+
+        /**
+         * Runs of one row strip of the obstacle labelling, parents index runs of the same strip
+         **/
+        struct ObstacleStrip
+        {
+            std::vector<ObstacleRun> runs;
+            std::vector<int> parents;
+        };
+
+        /**
+         * Rows of occupancy words and decimation flags used by one task of the site scan, kept between scans
+         **/
+        struct SiteScratch
+        {
+            std::vector<uint64_t> window_columns;
+            std::vector<uint64_t> above;
+            std::vector<uint64_t> current;
+            std::vector<uint64_t> below;
+            std::vector<char> block_taken;
+        };
+
+        /**
+         * Bump allocator handed to jc_voronoi for diagram generation. Memory is only released with the arena, blocks used
+         * by a generation are merged into one on reset so that following generations of similar size do not allocate
+         **/
+        class GenerationArena
+        {
+        public:
+            /**
+             * Make all memory available again. Only call once diagrams generated with this arena are freed
+             **/
+            void reset();
+
+            void *allocate(size_t size);
+
+            static void *allocFn(void *arena, size_t size)
+            {
+                return static_cast<GenerationArena *>(arena)->allocate(size);
+            }
+
+            static void freeFn(void *, void *)
+            {
+            }
+
+        private:
+            struct Block
+            {
+                std::unique_ptr<char[]> data;
+                size_t size = 0;
+            };
+
+            std::vector<Block> blocks;
+            size_t block_idx = 0;
+            size_t used = 0;
+
+            /**
+             * Minimum size of new blocks, jc_voronoi requests 16kB blocks after its initial allocation
+             **/
+            static const size_t MIN_BLOCK_SIZE = 1 << 20;
+        };
+
         /**
          * Pointer to map from the ROS side of planner
          **/
@@ -366,6 +995,30 @@ namespace voronoi_path
          **/
         std::vector<GraphNode> node_inf;
 
+        /**
+         * Homotopy contributions of the edges in adj_list, edge_homotopy[i][j] is the edge from node i to adj_list[i][j].
+         * Built with the graph, so Yen's edge removals do not affect it
+         **/
+        std::vector<std::vector<EdgeHomotopy>> edge_homotopy;
+        std::vector<std::pair<int, int>> edge_crossings;
+
+        /**
+         * Faces of the graph when use_face_classes is set, and the vertex of the embedding of each node. Nodes closer than a
+         * hundredth of a cell are one vertex, edges between the same two vertices are one edge of the embedding
+         **/
+        std::vector<GraphFace> graph_faces;
+        std::vector<int> node_vertices;
+
+        /**
+         * Sum of obstacle coefficients times log(node - center) of nodes that were path end points since the graph was built
+         **/
+        std::map<int, std::complex<double>> node_potentials;
+
+        /**
+         * (y, index) of centers sorted by y, for finding the centers an edge can cross the branch cut of
+         **/
+        std::vector<std::pair<double, int>> centers_by_y;
+
         /**
          * Vector storing the coordinate of the 4 corners of the local costmap (ROS). Used to unsure that a path can be found 
          * even in a sparse global map
@@ -397,6 +1050,29 @@ namespace voronoi_path
          **/
         std::vector<std::complex<double>> obs_coeff;
 
+        /**
+         * IDs of the obstacles in centers, for winding numbers
+         **/
+        std::vector<uint32_t> center_ids;
+
+        /**
+         * Coordinates of centers as separate arrays for calculating homotopy classes
+         **/
+        std::vector<double> center_x;
+        std::vector<double> center_y;
+
+        /**
+         * Smaller side of the bounds of the obstacles in centers, in cells
+         **/
+        std::vector<int> center_sizes;
+
+        /**
+         * Start and goal of the last query, obstacles used for homotopy classes lie in an ellipse around them
+         **/
+        GraphNode homotopy_corridor_start;
+        GraphNode homotopy_corridor_end;
+        bool has_homotopy_corridor = false;
+
         /**
          * Stores total number of nodes, ie adj_list.size()
          **/
@@ -408,6 +1084,180 @@ namespace voronoi_path
          **/
         int bezier_max_n = 26;
 
+        /**
+         * Coarse graphs ordered from finest to coarsest, rebuilt whenever this graph is regenerated
+         **/
+        std::vector<CoarseLevel> coarse_graphs;
+
+        /**
+         * Worker threads shared by all parallel stages, and with the coarse graphs. Created on first use, recreated if num_threads changes
+         **/
+        std::shared_ptr<ThreadPool> thread_pool;
+
+        /**
+         * Sites of the last scan, band offsets of each task into it and per task scratch. Kept between mapToGraph calls so
+         * that rebuilds only allocate when the number of sites or the window grows
+         **/
+        std::vector<jcv_point> site_buffer;
+        std::vector<int> site_offsets;
+        std::vector<SiteScratch> site_scratch;
+
+        /**
+         * Obstacles of the planning window in ascending ID order, centers and obs_coeff follow the same order
+         **/
+        std::vector<Obstacle> obstacles;
+
+        /**
+         * ID given to the next new obstacle
+         **/
+        uint32_t next_obstacle_id = 0;
+
+        /**
+         * Window and threshold obstacles were labelled with, the whole window is relabelled if either changes
+         **/
+        MapRect obstacles_window;
+        int obstacles_threshold = -1;
+        double obstacles_min_area = -1;
+        bool obstacles_filter_sites = false;
+
+        /**
+         * Cells of insignificant obstacles when filter_obstacle_sites is set, same layout as the bitplanes. Words that are
+         * set are listed in ignored_site_words so they can be cleared without clearing the whole plane
+         **/
+        std::vector<uint64_t> ignored_sites;
+        std::vector<int> ignored_site_words;
+
+        /**
+         * Row strips of the obstacle labelling and parents of all runs once strips are joined, kept between calls
+         **/
+        std::vector<ObstacleStrip> obstacle_strips;
+        std::vector<int> obstacle_parents;
+        std::vector<int> obstacle_strip_offsets;
+        std::vector<int> obstacle_roots;
+
+        /**
+         * Scratch of findObstacleCentroids and updateHomotopyObstacles, kept between calls. affected_cells holds (hash of
+         * the first cell, index) of obstacles touching the relabelled region, sorted by hash
+         **/
+        std::vector<bool> affected_obstacles;
+        std::vector<std::pair<uint64_t, int>> affected_cells;
+        std::vector<Obstacle> found_obstacles;
+        std::vector<Obstacle> added_obstacles;
+        std::vector<Obstacle> remaining_obstacles;
+        std::vector<Obstacle> entered_obstacles;
+        std::vector<Obstacle> left_obstacles;
+        std::vector<uint32_t> previous_center_ids;
+        std::vector<std::complex<double>> previous_centers;
+        std::vector<std::pair<int, int>> fill_stack;
+
+        /**
+         * Memory for voronoi diagram generation
+         **/
+        GenerationArena generation_arena;
+
+        /**
+         * Set on graphs owned as a coarse level. Start and goal often lie in blocked cells after max-pooling, so nearest
+         * nodes are found by distance only and collisions are left to refinement on the finer graphs
+         **/
+        bool is_coarse_level = false;
+
+        /**
+         * Number of levels in the cost pyramid, and log2 of the number of cells (or tiles of the level below) along each side of a tile.
+         * Level 0 tiles are 8x8 cells, level 1 tiles are 64x64 cells
+         **/
+        static const int PYRAMID_LEVELS = 2;
+        static const int PYRAMID_SHIFT = 3;
+
+        /**
+         * Max-pooled costs of map cells, excluding the overlay. cost_pyramid[level][tile_y * pyramid_widths[level] + tile_x]
+         * is the highest cost in that tile, used to prove that a region is free without reading its cells
+         **/
+        std::vector<std::vector<signed char>> cost_pyramid;
+
+        /**
+         * Number of tiles along the width and height of each pyramid level
+         **/
+        std::vector<int> pyramid_widths;
+        std::vector<int> pyramid_heights;
+
+        /**
+         * Size of the map the pyramid was built for, pyramid is rebuilt entirely when the map is resized
+         **/
+        int pyramid_map_width = 0;
+        int pyramid_map_height = 0;
+
+        /**
+         * Indices of the bitplanes, one per threshold used on map cells
+         **/
+        enum Bitplane
+        {
+            OCCUPANCY_PLANE,
+            COLLISION_PLANE,
+            TRIMMING_PLANE,
+            NUM_PLANES
+        };
+
+        /**
+         * Map cells excluding the overlay, packed 1 bit per cell. Bit (x & 63) of bitplanes[plane][y * bitplane_words_per_row + (x >> 6)]
+         * is set if the cost of cell (x, y) is > bitplane_thresholds[plane]
+         **/
+        std::vector<uint64_t> bitplanes[NUM_PLANES];
+        int bitplane_words_per_row = 0;
+
+        /**
+         * Thresholds and map size the bitplanes were built with, bitplanes are rebuilt entirely when any of them changes.
+         * Occupancy plane is stored as occupancy_threshold - 1 since occupied cells are >= occupancy_threshold
+         **/
+        int bitplane_thresholds[NUM_PLANES] = {0, 0, 0};
+        int bitplane_map_width = 0;
+        int bitplane_map_height = 0;
+
+        /**
+         * Start and goal given to setRegionOfInterest, in pixels
+         **/
+        bool roi_set = false;
+        GraphNode roi_start;
+        GraphNode roi_end;
+
+        /**
+         * Region of the map the current graph was built in. Cost pyramid, bitplanes and tile hashes are only kept up to date within it
+         **/
+        MapRect planning_window;
+
+        /**
+         * Log2 of the number of cells along each side of a hashed tile
+         **/
+        static const int TILE_SHIFT = 6;
+
+        /**
+         * Hash of the composited costs of every tile, tile_hashes[tile_y * tile_cols + tile_x]. Only tiles in dirty regions are rehashed
+         **/
+        std::vector<uint64_t> tile_hashes;
+        int tile_cols = 0;
+        int tile_rows = 0;
+
+        /**
+         * Indices into tile_hashes of tiles whose hash changed during the previous call to mapToGraph
+         **/
+        std::vector<int> changed_tiles;
+
+        /**
+         * Dirty regions of the map within the planning window and tiles already rehashed, kept between calls so that
+         * consuming dirty regions does not allocate
+         **/
+        std::vector<MapRect> dirty_regions;
+        std::vector<bool> hashed_tiles;
+
+        /**
+         * Set when the graph has to be regenerated even if no tile changed, eg. when local vertices moved
+         **/
+        bool graph_stale = true;
+
+        /**
+         * Whether the previous call to mapToGraph regenerated the graph
+         **/
+        bool graph_updated = false;
+
         /**
          * Vector to store all previously found paths for maintaining and trimming
          **/
@@ -428,26 +1278,145 @@ namespace voronoi_path
         uint32_t getUniqueID();
 
         /**
-         * Find centroid of obstacles using opencv findContour(), uses data from 'map' variable
+         * Find one point inside every obstacle of the planning window and the homotopy coefficients of these points. Obstacles
+         * are 8-connected components of cells above collision_threshold. Only obstacles around tiles that changed since the
+         * previous call are labelled again, other obstacles and their coefficients are kept
          * @return vector of complex numbers representing coordinates of centroids, for use in homotopy class checking
          **/
-        std::vector<std::complex<double>> findObstacleCentroids();
+        const std::vector<std::complex<double>> &findObstacleCentroids();
+
+        /**
+         * Method for threading the process of filling up occupancy vector by iterating through the map. Call once without points
+         * to count occupied pixels, then again with an array of that size to write them
+         * @param start_row map row to start looping from
+         * @param num_rows number of rows to iterate over and check for occupied pixels
+         * @param points array to write coordinates of occupied pixels to, only counted if nullptr
+         * @param scratch row buffers of the calling task
+         * @return number of occupied pixels
+         **/
+        int fillOccupancyVector(const int &start_row, const int &num_rows, jcv_point *points, SiteScratch &scratch);
+
+        /**
+         * Side of the square blocks of cells that sites are decimated to
+         * @return number of cells, 1 if decimation is disabled
+         **/
+        int siteBlockSize();
+
+        /**
+         * Find cells of the planning window above a cost threshold within 64 cells of a row, with the overlay composited
+         * @param y row
+         * @param word index of the 64 cells, cells [64 * word, 64 * word + 64) of the row
+         * @param threshold cells with cost greater than threshold are set
+         * @param plane bitplane of threshold, nullptr to compare map cells instead
+         * @return bit i is set if cell 64 * word + i is above threshold and inside the planning window
+         **/
+        uint64_t occupiedCells(int y, int word, int threshold, const std::vector<uint64_t> *plane);
+
+        /**
+         * Find runs of cells above collision_threshold in a band of rows and join runs of consecutive rows that touch
+         * @param region columns outside of region are ignored
+         * @param start_row first row of the band
+         * @param num_rows number of rows in the band
+         * @param strip runs and union-find parents of the band, indices local to the strip
+         **/
+        void labelObstacleStrip(const MapRect &region, int start_row, int num_rows, ObstacleStrip &strip);
+
+        /**
+         * Label obstacles within a region with union-find over runs of cells in parallel row strips. The point of an
+         * obstacle is the center of its first cell in row-major order
+         * @param region cells to label, obstacles are cut off at its border
+         * @param found obstacles in the region, without IDs
+         **/
+        void labelObstacles(const MapRect &region, std::vector<Obstacle> &found);
+
+        /**
+         * Mark cells of insignificant obstacles in ignored_sites, or clear it if filter_obstacle_sites is not set
+         **/
+        void updateIgnoredSites();
+
+        /**
+         * Rebuild centers and the other obstacle arrays used for homotopy classes from the significant obstacles inside the
+         * homotopy corridor, and update classes of previous_paths with obstacles that entered or left
+         * @return true if any obstacle entered or left
+         **/
+        bool updateHomotopyObstacles();
+
+        /**
+         * Check whether a point lies inside the homotopy corridor, always true if homotopy_corridor_ratio is not set
+         **/
+        bool inHomotopyCorridor(const std::complex<double> &point);
+
+        /**
+         * Set start and goal of the homotopy corridor for the next query, updating obstacles and edge terms if needed
+         **/
+        void setHomotopyCorridor(const GraphNode &start, const GraphNode &end);
+
+        /**
+         * Homotopy coefficient of an obstacle, depends on the ID only so coefficients of other obstacles stay the same when
+         * obstacles are added or removed
+         **/
+        static std::complex<double> obstacleCoefficient(uint32_t id);
+
+        /**
+         * Count signed crossings of a path with the branch cut of arg around each center, the ray going from the center
+         * towards -x. Crossing downwards counts +1, upwards -1
+         * @param path path to check
+         * @param center_x x coordinates of centers
+         * @param center_y y coordinates of centers
+         * @param num_centers number of centers
+         * @param crossings crossings of every center, whole numbers stored as double to be counted in the same SIMD lanes
+         **/
+        static void pathCrossings(const std::vector<GraphNode> &path, const double *center_x, const double *center_y, int num_centers, double *crossings);
+
+        /**
+         * Add signed crossings of one edge with the branch cut around each center to crossings, see pathCrossings
+         **/
+        static void segmentCrossings(const GraphNode &from, const GraphNode &to, const double *center_x, const double *center_y, int num_centers, double *crossings);
+
+        /**
+         * Homotopy value of a path around one obstacle, before multiplying with the obstacle's coefficient. Equal to the sum
+         * of log(z - center) over the path's edges, which only depends on the end points and the number of crossings of the
+         * branch cut
+         **/
+        static std::complex<double> pathHomotopy(const GraphNode &start, const GraphNode &end, const std::complex<double> &center, double crossings);
 
         /**
-         * Method for threading the process of filling up occupancy vector by iterating through the map
-         * @param start_index pixel to start looping from
-         * @param num_pixels number of pixels to iterate over and check if it's occupied
-         * @return returns vector of coordinates to occupied pixels
+         * Update homotopy classes of previous_paths with the terms of removed and added obstacles only
          **/
-        std::vector<jcv_point> fillOccupancyVector(const int &start_index, const int &num_pixels);
+        void updatePathClasses(const std::vector<Obstacle> &removed, const std::vector<Obstacle> &added);
 
         /**
-         * Hashing function for 2 doubles, order of values matters
+         * Join the sets of two elements, the root with the smaller index becomes the root of both
+         **/
+        static void unionRoots(std::vector<int> &parents, int a, int b);
+
+        /**
+         * Find root of an element with path halving
+         **/
+        static int findRoot(std::vector<int> &parents, int a);
+
+        /**
+         * Bits for the columns in [begin, end) among 64 columns starting at x0
+         * @return bit i is set if x0 + i lies in [begin, end)
+         **/
+        static uint64_t columnMask(int x0, int begin, int end);
+
+        /**
+         * Compare up to 64 consecutive cells against a threshold, 32 (AVX2) or 16 (SSE2) cells at a time when available
+         * @param cells first cell to compare
+         * @param count number of cells, at most 64
+         * @param threshold cells with cost > threshold are set
+         * @return bit i is set if cells[i] > threshold
+         **/
+        static uint64_t thresholdMask(const signed char *cells, int count, int threshold);
+
+        /**
+         * Hashing function for 2 doubles, order of values matters. Values are truncated to 32 bits each
          * @param x first value
          * @param y second value
          * @return hash
          **/
-        uint32_t hash(const double &x, const double &y);
+        uint64_t hash(const double &x, const double &y);
 
         /**
          * Find nearest starting and ending node, given starting and ending coordinates
@@ -470,15 +1439,71 @@ namespace voronoi_path
          **/
         bool kthShortestPaths(const int &start_node, const int &end_node, const std::vector<int> &shortestPath, std::vector<std::vector<int>> &all_paths, const int &num_paths);
 
+        /**
+         * Find paths of distinct homotopy classes with A* over the graph augmented with the class of the path reaching each
+         * node. States are told apart by the cut crossings of their path, paths at the goal with a HomotopyRegistry. Paths do
+         * not visit a node twice. A node is no longer expanded once num_paths classes reached it, which assumes any path from
+         * there to the goal could follow them. With paths kept simple this does not always hold, so a class Yen's algorithm
+         * would return can be missed or found with a longer path
+         * @param start_node node number of starting node
+         * @param end_node node number of ending node
+         * @param all_paths paths found, shortest first
+         * @param num_paths number of paths to find, including the shortest path
+         * @return boolean indicating whether num_paths paths were found
+         **/
+        bool findHomotopyPaths(const int &start_node, const int &end_node, std::vector<std::vector<int>> &all_paths, const int &num_paths);
+
         /**
          * Find shortest path using A* algorithm and Euclidean distance heuristic
          * @param start_node node number of starting node
          * @param end_node node number of ending node
          * @param path shortest path that was found
-         * @param cost cost of the shortest path, sum of all edge lengths in the path, units are pixels
+         * @param node_mask if given, only nodes i with (*node_mask)[i] set are expanded
+         * @return boolean indicating success
+         **/
+        bool findShortestPath(const int &start_node, const int &end_node, std::vector<int> &path, const std::vector<bool> *node_mask = nullptr);
+
+        /**
+         * Convert node paths into Paths from start to end, interpolate and contract them, and store them as previous paths
+         * if there are none yet
+         * @param start starting coordinates in pixels
+         * @param end ending coordinates in pixels
+         * @param all_paths node paths, shortest first
+         * @return converted paths
+         **/
+        std::vector<Path> buildPaths(const GraphNode &start, const GraphNode &end, const std::vector<std::vector<int>> &all_paths);
+
+        /**
+         * Get the thread pool, creating it if it does not exist yet or num_threads changed
+         * @return thread pool with num_threads threads
+         **/
+        ThreadPool &getThreadPool();
+
+        /**
+         * Max-pool the planning window into every coarse level and regenerate their graphs
+         **/
+        void updateCoarseGraphs();
+
+        /**
+         * Find routes of distinct homotopy classes on the coarsest graph and refine each through every finer level
+         * @param start starting coordinates in pixels
+         * @param end ending coordinates in pixels
+         * @param num_paths number of routes to find on the coarsest graph
+         * @param all_paths node paths on this graph of the routes that could be refined, shortest first
+         * @return true if any route was refined
+         **/
+        bool findCoarseToFinePaths(const GraphNode &start, const GraphNode &end, int num_paths, std::vector<std::vector<int>> &all_paths);
+
+        /**
+         * Find the shortest path using only nodes near a route
+         * @param start starting coordinates in pixels
+         * @param end ending coordinates in pixels
+         * @param route route to search around, in pixels
+         * @param radius distance from the route in pixels within which nodes may be used
+         * @param path shortest path that was found
          * @return boolean indicating success
          **/
-        bool findShortestPath(const int &start_node, const int &end_node, std::vector<int> &path);
+        bool findCorridorPath(const GraphNode &start, const GraphNode &end, const std::vector<GraphNode> &route, double radius, std::vector<int> &path);
 
         /**
          * Removes voronoi vertices that are in obstacles
@@ -506,6 +1531,73 @@ namespace voronoi_path
          **/
         bool edgeCollides(const GraphNode &start, const GraphNode &end, int threshold);
 
+        /**
+         * Refresh the cost pyramid over regions of the map that changed, or entirely if the map was resized
+         * @param region region of the map that changed, in cells
+         **/
+        void updateCostPyramid(const MapRect &region);
+
+        /**
+         * Get the region of the map to build the graph in
+         * @return window around start and goal given to setRegionOfInterest, whole map if roi_margin is not set
+         **/
+        MapRect getPlanningWindow();
+
+        /**
+         * Refresh cost pyramid and bitplanes over dirty regions of the map within window, then clear the dirty regions.
+         * Caches are refreshed over the whole window if it differs from planning_window
+         * @param window window the graph is going to be built in
+         **/
+        void refreshMapCaches(const MapRect &window);
+
+        /**
+         * Rehash tiles in dirty regions of the map within window and record the ones whose hash changed in changed_tiles.
+         * All tiles in window count as changed if it differs from planning_window
+         * @param window window the graph is going to be built in
+         * @return true if any tile changed
+         **/
+        bool updateTileHashes(const MapRect &window);
+
+        /**
+         * Hash the composited costs of a tile
+         * @param tile_x column of the tile
+         * @param tile_y row of the tile
+         * @return hash of the tile
+         **/
+        uint64_t hashTile(int tile_x, int tile_y);
+
+        /**
+         * Check if the bitplanes were built for the current map size and thresholds
+         * @return true if bitplanes can be used in place of map cells outside of the overlay and dirty regions
+         **/
+        bool bitplanesValid();
+
+        /**
+         * Refresh the bitplanes over regions of the map that changed, or entirely if the map size or thresholds changed
+         * @param region region of the map that changed, in cells
+         **/
+        void updateBitplanes(const MapRect &region);
+
+        /**
+         * Get the bitplane built for a threshold
+         * @param threshold cost threshold, cells with cost > threshold are set in the plane
+         * @return pointer to the plane, nullptr if there is no valid plane for threshold or use_bitplanes is not set
+         **/
+        const std::vector<uint64_t> *getBitplane(int threshold);
+
+        /**
+         * Use the cost pyramid to skip collision samples that lie in tiles whose highest cost is within threshold
+         * @param start position of sample 0
+         * @param increment_x x increment between samples
+         * @param increment_y y increment between samples
+         * @param step index of current sample
+         * @param pixel_x column of the cell of the current sample
+         * @param pixel_y row of the cell of the current sample
+         * @param threshold collision threshold
+         * @return index of the next sample that has to be checked, step itself if the current cell has to be checked
+         **/
+        int skipFreeTiles(const GraphNode &start, double increment_x, double increment_y, int step, int pixel_x, int pixel_y, int threshold);
+
         /**
          * Manhattan distance from a to b
          * @param a pixel position of point a
@@ -529,12 +1621,66 @@ namespace voronoi_path
         int getNumberOfNodes();
 
         /**
-         * Calculate the homotopy class, algorithm from paper "Search-Based Path Planning with Homotopy Class Constraints"
-         * by Subhrajit Bhattacharya et al https://www.cs.huji.ac.il/~jeff/aaai10/02/AAAI10-216.pdf
-         * @param path_ path to calculate homotopy class
-         * @return complex value representing the homotopy class of path_
+         * Homotopy class of a node path from the precomputed edge contributions, same as calcHomotopyClass of the path's
+         * pixels without looping over obstacles for every edge
+         * @param path node path
+         * @param edge_terms sum of the terms of all edges of path, see sumEdgeTerms
+         * @return H-signature and winding numbers of path. With use_face_classes, the sum of face cut terms and the counts of
+         * face cuts crossed
+         **/
+        HomotopyClass nodePathClass(const std::vector<int> &path, const std::complex<double> &edge_terms);
+        HomotopyClass nodePathClass(const std::vector<int> &path);
+
+        /**
+         * Sum of the terms of edges from path[first] up to path[last]
+         **/
+        std::complex<double> sumEdgeTerms(const std::vector<int> &path, int first, int last);
+
+        /**
+         * Trace the faces of adj_list from the counter-clockwise order of edges around each node, and build the tree of faces
+         * of each connected component with breadth first search from its outer face
+         **/
+        void updateGraphFaces();
+
+        /**
+         * Precompute edge_homotopy for every edge of adj_list, called after the graph and obstacles are updated. With
+         * use_face_classes, obstacles are assigned the bounded face their point lies in and edges count the cuts through them
          **/
-        std::complex<double> calcHomotopyClass(const std::vector<GraphNode> &path_);
+        void updateEdgeHomotopy();
+
+        /**
+         * Find the contribution of the edge from node to next_node
+         * @return contribution, nullptr if the edge was not part of the graph when edge_homotopy was built
+         **/
+        const EdgeHomotopy *findEdgeHomotopy(int node, int next_node);
+
+        /**
+         * Term of an edge, see EdgeHomotopy
+         * @param from start of the edge
+         * @param to end of the edge
+         * @param crossings if not null, (center index, count) pairs of centers that are crossed are appended
+         * @return 2*pi*i times the sum of obstacle coefficients weighted by crossings
+         **/
+        std::complex<double> edgeTerm(const GraphNode &from, const GraphNode &to, std::vector<std::pair<int, int>> *crossings);
+
+        /**
+         * Homotopy class of a previous path after replanning moved its start and contracted it, without recomputing the
+         * whole path. Contraction only changes the class of the path when it jumps over obstacles narrower than the
+         * waypoint separation, crossings of those are counted on both paths
+         * @param previous previous path with its class
+         * @param path replanned path, with the same end as previous
+         * @param narrow_centers indices of centers with obstacles at most path_waypoint_sep across
+         * @return class of path
+         **/
+        HomotopyClass replannedPathClass(const Path &previous, const std::vector<GraphNode> &path, const std::vector<int> &narrow_centers);
+
+        /**
+         * Number of times a path, closed by a straight line from its end back to its start, winds around a point
+         * @param path path to check
+         * @param center point to wind around
+         * @return winding number, positive for counter-clockwise
+         **/
+        int windingNumber(const std::vector<GraphNode> &path, const std::complex<double> &center);
 
         /**
          * Convert node based path to pixel based path
@@ -558,14 +1704,6 @@ namespace voronoi_path
          **/
         bool interpolateContractPaths(std::vector<Path> &paths);
 
-        /**
-         * Checks if the two complex homotopy classes are outside the threshold, ie unique/different
-         * @param complex_1 class 1 to check
-         * @param complex_2 class 2 to check
-         * @return bool indicating true if the 2 classes are unique
-         **/
-        bool isClassDifferent(const std::complex<double> &complex_1, const std::complex<double> &complex_2);
-
         /**
          * Traverses recursively a branch from dead end side towards branch side, if branch is found, then entire series of edges are removed
          * If branch is not found before lonely_branch_dist_threshold, then branch is not removed
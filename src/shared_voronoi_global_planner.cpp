@@ -34,20 +34,27 @@ namespace shared_voronoi_global_planner
 
     void SharedVoronoiGlobalPlanner::updateVoronoiCB(const ros::WallTimerEvent &e)
     {
+        //Pull the latest costmap in process, instead of waiting for it to be published
+        if (use_costmap_ros)
+            readCostmapROS();
+
         if (update_voronoi_rate == 0)
         {
             ros::Rate r(1);
-            while (map.data.empty())
+            while (map.empty())
             {
                 ROS_WARN("Map is still empty, unable to initialize, waiting until map is not empty");
                 r.sleep();
                 ros::spinOnce();
+
+                if (use_costmap_ros)
+                    readCostmapROS();
             }
         }
 
         else
         {
-            if (map.data.empty())
+            if (map.empty())
             {
                 ROS_WARN("Map is still empty, skipping update of voronoi diagram");
                 return;
@@ -55,9 +62,21 @@ namespace shared_voronoi_global_planner
         }
 
         //Call voronoi object to update its internal voronoi diagram
-        voronoi_path.mapToGraph(&map);
+        {
+            std::lock_guard<std::mutex> lock(map_mtx);
+            voronoi_path.mapToGraph(&map);
+        }
+
+        //Map did not change since the previous update, published graph is still current
+        if (!voronoi_path.isGraphUpdated())
+            return;
+
         ROS_WARN("Voronoi diagram initialized");
+        publishVoronoiGraph();
+    }
 
+    void SharedVoronoiGlobalPlanner::publishVoronoiGraph()
+    {
         //Publish adjacency list and corresponding info to
         std::vector<std::vector<int>> adj_list_raw = voronoi_path.getAdjList();
         std::vector<voronoi_path::GraphNode> node_inf_raw = voronoi_path.getNodeInfo();
@@ -86,11 +105,29 @@ namespace shared_voronoi_global_planner
         {
             readParams();
 
+            //Same translation from costmap costs to occupancy values as costmap_2d's publisher, so thresholds are identical in both modes
+            cost_translation_table[costmap_2d::FREE_SPACE] = 0;
+            cost_translation_table[costmap_2d::INSCRIBED_INFLATED_OBSTACLE] = 99;
+            cost_translation_table[costmap_2d::LETHAL_OBSTACLE] = 100;
+            cost_translation_table[costmap_2d::NO_INFORMATION] = -1;
+            for (int i = 1; i < costmap_2d::INSCRIBED_INFLATED_OBSTACLE; ++i)
+                cost_translation_table[i] = static_cast<signed char>(1 + (97 * (i - 1)) / 251);
+
             //Subscribe and advertise related topics
-            global_costmap_sub = nh.subscribe("/move_base/global_costmap/costmap", 1, &SharedVoronoiGlobalPlanner::globalCostmapCB, this);
+            costmap_ros_ = costmap_ros;
+            if (use_costmap_ros && costmap_ros_ == nullptr)
+            {
+                ROS_WARN("use_costmap_ros is set but no costmap was given during initialization, subscribing to costmap topics instead");
+                use_costmap_ros = false;
+            }
+
+            if (!use_costmap_ros)
+            {
+                global_costmap_sub = nh.subscribe("/move_base/global_costmap/costmap", 1, &SharedVoronoiGlobalPlanner::globalCostmapCB, this);
 
-            if (!static_global_map)
-                global_update_sub = nh.subscribe("/move_base/global_costmap/costmap_updates", 1, &SharedVoronoiGlobalPlanner::globalCostmapUpdateCB, this);
+                if (!static_global_map)
+                    global_update_sub = nh.subscribe("/move_base/global_costmap/costmap_updates", 1, &SharedVoronoiGlobalPlanner::globalCostmapUpdateCB, this);
+            }
 
             if (subscribe_local_costmap)
                 local_costmap_sub = nh.subscribe("/move_base/local_costmap/costmap", 1, &SharedVoronoiGlobalPlanner::localCostmapCB, this);
@@ -173,6 +210,12 @@ namespace shared_voronoi_global_planner
         //move_base had a goal previously set, so paths should be trimmed based on previous one instead of replanning entirely
         else if (voronoi_path.hasPreviousPaths() && prev_goal == end_point)
         {
+            std::lock_guard<std::mutex> lock(map_mtx);
+
+            //Robot left the planning window, move the window before replanning
+            if (voronoi_path.setRegionOfInterest(start_point, end_point) && voronoi_path.mapToGraph(&map))
+                publishVoronoiGraph();
+
             all_paths = voronoi_path.replan(start_point, end_point, num_paths, preferred_path);
         }
 
@@ -182,6 +225,12 @@ namespace shared_voronoi_global_planner
             //Clear all previous paths and preferences before getting new path
             voronoi_path.clearPreviousPaths();
             preferred_path = 0;
+            std::lock_guard<std::mutex> lock(map_mtx);
+
+            //Graph is only built around start and goal when roi_margin is set, build it around the new goal first
+            if (voronoi_path.setRegionOfInterest(start_point, end_point) && voronoi_path.mapToGraph(&map))
+                publishVoronoiGraph();
+
             all_paths = voronoi_path.getPath(start_point, end_point, num_paths);
             prev_goal = end_point;
         }
@@ -438,78 +487,158 @@ namespace shared_voronoi_global_planner
 
     void SharedVoronoiGlobalPlanner::localCostmapCB(const nav_msgs::OccupancyGrid::ConstPtr &msg)
     {
-        auto local_start = std::chrono::system_clock::now();
-        local_costmap = *msg;
-
-        //Merge costmaps if global map is not empty
-        if (!local_costmap.data.empty())
-        {
-            //Get origin of local_costmap wrt to origin of global_costmap
-            double rel_local_x = -map.origin.position.x + local_costmap.info.origin.position.x;
-            double rel_local_y = -map.origin.position.y + local_costmap.info.origin.position.y;
+        std::lock_guard<std::mutex> lock(map_mtx);
 
-            //Costmap is rotated ccw 90deg in rviz
-            //Convert distance to pixels in global costmap resolution
-            int x_pixel_offset = rel_local_x / map.resolution;
-            int y_pixel_offset = rel_local_y / map.resolution;
+        //Keep a reference to the message instead of copying it
+        local_costmap = msg;
 
-            if (add_local_costmap_corners)
-            {
-                std::vector<voronoi_path::GraphNode> local_vertices;
-                local_vertices.push_back(voronoi_path::GraphNode(x_pixel_offset, y_pixel_offset));
-                local_vertices.push_back(voronoi_path::GraphNode(x_pixel_offset + local_costmap.info.width, y_pixel_offset));
-                local_vertices.push_back(voronoi_path::GraphNode(x_pixel_offset + local_costmap.info.width, y_pixel_offset + local_costmap.info.height));
-                local_vertices.push_back(voronoi_path::GraphNode(x_pixel_offset, y_pixel_offset + local_costmap.info.height));
+        if (add_local_costmap_corners && !local_costmap->data.empty() && !map.empty())
+        {
+            voronoi_path::MapRect local_rect = getLocalCostmapRect();
+            std::vector<voronoi_path::GraphNode> local_vertices;
+            local_vertices.push_back(voronoi_path::GraphNode(local_rect.x, local_rect.y));
+            local_vertices.push_back(voronoi_path::GraphNode(local_rect.x + local_rect.width, local_rect.y));
+            local_vertices.push_back(voronoi_path::GraphNode(local_rect.x + local_rect.width, local_rect.y + local_rect.height));
+            local_vertices.push_back(voronoi_path::GraphNode(local_rect.x, local_rect.y + local_rect.height));
+
+            voronoi_path.setLocalVertices(local_vertices);
+        }
 
-                voronoi_path.setLocalVertices(local_vertices);
-            }
+        updateLocalCostmapOverlay();
+    }
 
-            //Restore modified global costmap pixels to old value in previous loop, in cases when local obstacle is moving
-            for (int i = 0; i < map_pixels_backup.size(); ++i)
-                map.data[map_pixels_backup[i].first] = map_pixels_backup[i].second;
+    voronoi_path::MapRect SharedVoronoiGlobalPlanner::getLocalCostmapRect()
+    {
+        if (!local_costmap || local_costmap->data.empty() || map.empty())
+            return voronoi_path::MapRect();
 
-            map_pixels_backup.clear();
+        //Get origin of local_costmap wrt to origin of global_costmap
+        double rel_local_x = -map.origin.position.x + local_costmap->info.origin.position.x;
+        double rel_local_y = -map.origin.position.y + local_costmap->info.origin.position.y;
 
-            //Copy data to internal map storage from local costmap if the pixel surpasses an occupancy threshold
-            for (int i = 0; i < local_costmap.data.size(); ++i)
-            {
-                int local_data = local_costmap.data[i];
+        //Costmap is rotated ccw 90deg in rviz
+        //Convert distance to pixels in global costmap resolution
+        return voronoi_path::MapRect(rel_local_x / map.resolution, rel_local_y / map.resolution,
+                                     local_costmap->info.width, local_costmap->info.height);
+    }
 
-                if (local_data >= occupancy_threshold)
-                {
-                    int global_curr_x = i % local_costmap.info.width + x_pixel_offset;
-                    int global_curr_y = i / local_costmap.info.width + y_pixel_offset;
-                    map_pixels_backup.emplace_back(global_curr_y * map.width + global_curr_x,
-                                                   map.data[global_curr_y * map.width + global_curr_x]);
-                    map.data[global_curr_y * map.width + global_curr_x] = local_data;
-                }
-            }
+    void SharedVoronoiGlobalPlanner::updateLocalCostmapOverlay()
+    {
+        voronoi_path::MapRect local_rect = getLocalCostmapRect();
+        if (local_rect.empty())
+        {
+            map.clearOverlay();
+            return;
         }
+
+        //Local cells surpassing the occupancy threshold are composited over the global costmap, global cells are left untouched
+        nav_msgs::OccupancyGrid::ConstPtr msg = local_costmap;
+        map.setOverlay(local_rect, msg->data.data(), std::shared_ptr<const void>(msg.get(), [msg](const void *) {}), occupancy_threshold);
     }
 
     void SharedVoronoiGlobalPlanner::globalCostmapCB(const nav_msgs::OccupancyGrid::ConstPtr &msg)
     {
-        //Copy all required data to internal map storage
+        std::lock_guard<std::mutex> lock(map_mtx);
+
+        //Copy map info to internal map storage, cells are viewed directly from the message which is kept alive by the map
         map.height = msg->info.height;
         map.width = msg->info.width;
         map.frame_id = msg->header.frame_id;
         map.resolution = msg->info.resolution;
         map.origin.position.x = msg->info.origin.position.x;
         map.origin.position.y = msg->info.origin.position.y;
-        map.data = msg->data;
+        map.setView(msg->data.data(), msg->data.size(), std::shared_ptr<const void>(msg.get(), [msg](const void *) {}));
+        map.clearDirty();
+        map.markDirty(voronoi_path::MapRect(0, 0, map.width, map.height));
+
+        //Origin or resolution might have changed, place the local costmap again
+        updateLocalCostmapOverlay();
     }
 
     void SharedVoronoiGlobalPlanner::globalCostmapUpdateCB(const map_msgs::OccupancyGridUpdate::ConstPtr &msg)
     {
-        //Assign update of map data to local copy of map
-        map.data = msg->data;
+        std::lock_guard<std::mutex> lock(map_mtx);
+
+        //Updates are patches of the full map, cannot be applied before the full map is received
+        if (map.empty())
+            return;
+
+        if (msg->data.size() != static_cast<size_t>(msg->width) * msg->height)
+        {
+            ROS_WARN("Global costmap update has %ld cells, expected %d, ignoring update", msg->data.size(), msg->width * msg->height);
+            return;
+        }
+
+        //Copy patch into local copy of map at its offset. Local costmap is an overlay so it is not affected by the patch
+        map.applyPatch(voronoi_path::MapRect(msg->x, msg->y, msg->width, msg->height), msg->data.data());
+    }
+
+    bool SharedVoronoiGlobalPlanner::readCostmapROS()
+    {
+        costmap_2d::Costmap2D *costmap = costmap_ros_->getCostmap();
+        if (costmap == nullptr)
+            return false;
+
+        std::lock_guard<std::mutex> map_lock(map_mtx);
 
-        //Call local costmap cb to make sure that local obstacles are not overwritten by global costmap update
-        if (!map.data.empty())
         {
-            const auto costmap_ptr = boost::make_shared<nav_msgs::OccupancyGrid>(local_costmap);
-            localCostmapCB(costmap_ptr);
+            boost::unique_lock<costmap_2d::Costmap2D::mutex_t> lock(*(costmap->getMutex()));
+
+            int width = costmap->getSizeInCellsX();
+            int height = costmap->getSizeInCellsY();
+            const unsigned char *char_map = costmap->getCharMap();
+            if (char_map == nullptr || width == 0 || height == 0)
+                return false;
+
+            //Size, resolution or origin changed, eg. rolling window or resized static layer. Whole map has to be replaced
+            if (map.width != width || map.height != height || map.size() != static_cast<size_t>(width) * height ||
+                map.resolution != costmap->getResolution() || map.origin.position.x != costmap->getOriginX() ||
+                map.origin.position.y != costmap->getOriginY())
+            {
+                std::vector<signed char> cells(static_cast<size_t>(width) * height);
+                for (int i = 0; i < cells.size(); ++i)
+                    cells[i] = cost_translation_table[char_map[i]];
+
+                map.width = width;
+                map.height = height;
+                map.resolution = costmap->getResolution();
+                map.origin.position.x = costmap->getOriginX();
+                map.origin.position.y = costmap->getOriginY();
+                map.frame_id = costmap_ros_->getGlobalFrameID();
+                map.setData(std::move(cells));
+                map.clearDirty();
+                map.markDirty(voronoi_path::MapRect(0, 0, width, height));
+                updateLocalCostmapOverlay();
+            }
+
+            //Same geometry, translate and compare in a single pass, only changed cells are written and tracked
+            else
+            {
+                signed char *map_data = map.mutableCells();
+                int min_x = width, min_y = height, max_x = -1, max_y = -1;
+                for (int y = 0; y < height; ++y)
+                {
+                    int row = y * width;
+                    for (int x = 0; x < width; ++x)
+                    {
+                        signed char cell = cost_translation_table[char_map[row + x]];
+                        if (map_data[row + x] != cell)
+                        {
+                            map_data[row + x] = cell;
+                            min_x = std::min(min_x, x);
+                            max_x = std::max(max_x, x);
+                            min_y = std::min(min_y, y);
+                            max_y = y;
+                        }
+                    }
+                }
+
+                if (max_x >= 0)
+                    map.markDirty(voronoi_path::MapRect(min_x, min_y, max_x - min_x + 1, max_y - min_y + 1));
+            }
         }
+
+        return true;
     }
 
     void SharedVoronoiGlobalPlanner::cmdVelCB(const geometry_msgs::Twist::ConstPtr &msg)
@@ -683,8 +812,20 @@ namespace shared_voronoi_global_planner
         nh.getParam("print_timings", print_timings);
         nh.getParam("line_check_resolution", line_check_resolution);
         nh.getParam("pixels_to_skip", pixels_to_skip);
-        nh.getParam("open_cv_scale", open_cv_scale);
+        nh.getParam("boundary_sites", boundary_sites);
+        nh.getParam("site_tolerance", site_tolerance);
+        nh.getParam("min_obstacle_area", min_obstacle_area);
+        nh.getParam("filter_obstacle_sites", filter_obstacle_sites);
+        nh.getParam("use_bitplanes", use_bitplanes);
+        nh.getParam("roi_margin", roi_margin);
+        nh.getParam("coarse_levels", coarse_levels);
+        nh.getParam("num_threads", num_threads);
+        nh.getParam("corridor_radius", corridor_radius);
         nh.getParam("h_class_threshold", h_class_threshold);
+        nh.getParam("use_winding_numbers", use_winding_numbers);
+        nh.getParam("use_face_classes", use_face_classes);
+        nh.getParam("use_homotopy_search", use_homotopy_search);
+        nh.getParam("homotopy_corridor_ratio", homotopy_corridor_ratio);
         nh.getParam("min_node_sep_sq", min_node_sep_sq);
         nh.getParam("extra_point_distance", extra_point_distance);
         nh.getParam("add_local_costmap_corners", add_local_costmap_corners);
@@ -703,6 +844,7 @@ namespace shared_voronoi_global_planner
         nh.getParam("search_radius", search_radius);
         nh.getParam("selection_threshold", selection_threshold);
         nh.getParam("static_global_map", static_global_map);
+        nh.getParam("use_costmap_ros", use_costmap_ros);
         nh.getParam("xy_goal_tolerance", xy_goal_tolerance);
         nh.getParam("odom_topic", odom_topic);
         nh.getParam("sorted_nodes_dist_thresh", sorted_nodes_dist_thresh);
@@ -711,16 +853,34 @@ namespace shared_voronoi_global_planner
         nh.getParam("joy_input_thresh", joy_input_thresh);
         nh.getParam("publish_path_point_markers", publish_path_point_markers);
 
+        if (homotopy_corridor_ratio > 0 && homotopy_corridor_ratio < 1)
+        {
+            ROS_WARN("homotopy_corridor_ratio of %f gives an empty ellipse, using 1 instead", homotopy_corridor_ratio);
+            homotopy_corridor_ratio = 1;
+        }
+
         //Set parameters for voronoi path object
         voronoi_path.h_class_threshold = h_class_threshold;
+        voronoi_path.use_winding_numbers = use_winding_numbers;
+        voronoi_path.use_face_classes = use_face_classes;
+        voronoi_path.use_homotopy_search = use_homotopy_search;
+        voronoi_path.homotopy_corridor_ratio = homotopy_corridor_ratio;
         voronoi_path.print_timings = print_timings;
         voronoi_path.node_connection_threshold_pix = node_connection_threshold_pix;
         voronoi_path.extra_point_distance = extra_point_distance;
         voronoi_path.min_node_sep_sq = min_node_sep_sq;
         voronoi_path.trimming_collision_threshold = trimming_collision_threshold;
         voronoi_path.search_radius = search_radius;
-        voronoi_path.open_cv_scale = open_cv_scale;
         voronoi_path.pixels_to_skip = pixels_to_skip;
+        voronoi_path.boundary_sites = boundary_sites;
+        voronoi_path.site_tolerance = site_tolerance;
+        voronoi_path.min_obstacle_area = min_obstacle_area;
+        voronoi_path.filter_obstacle_sites = filter_obstacle_sites;
+        voronoi_path.use_bitplanes = use_bitplanes;
+        voronoi_path.roi_margin = roi_margin;
+        voronoi_path.coarse_levels = coarse_levels;
+        voronoi_path.num_threads = num_threads;
+        voronoi_path.corridor_radius = corridor_radius;
         voronoi_path.lonely_branch_dist_threshold = lonely_branch_dist_threshold;
         voronoi_path.path_waypoint_sep = path_waypoint_sep;
     }
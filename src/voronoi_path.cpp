@@ -2,10 +2,16 @@
 #include <iostream>
 #include <algorithm>
 #include <exception>
-#include <future>
 #include <thread>
 #include <functional>
 #include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <queue>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 #include <profiler.h>
 
@@ -15,8 +21,48 @@ namespace voronoi_path
     {
     }
 
+    bool voronoi_path::setRegionOfInterest(const GraphNode &start, const GraphNode &end)
+    {
+        roi_start = start;
+        roi_end = end;
+        roi_set = true;
+
+        if (roi_margin <= 0)
+            return false;
+
+        return !planning_window.contains(floor(start.x), floor(start.y)) || !planning_window.contains(floor(end.x), floor(end.y));
+    }
+
+    MapRect voronoi_path::getPlanningWindow()
+    {
+        MapRect map_rect(0, 0, map_ptr->width, map_ptr->height);
+        if (roi_margin <= 0)
+            return map_rect;
+
+        if (!roi_set)
+            return MapRect();
+
+        //Bounding box of start and goal, grown by the margin on every side
+        double margin = roi_margin / map_ptr->resolution;
+        int x0 = floor(std::min(roi_start.x, roi_end.x) - margin);
+        int y0 = floor(std::min(roi_start.y, roi_end.y) - margin);
+        int x1 = ceil(std::max(roi_start.x, roi_end.x) + margin);
+        int y1 = ceil(std::max(roi_start.y, roi_end.y) + margin);
+        return MapRect(x0, y0, x1 - x0 + 1, y1 - y0 + 1).intersect(map_rect);
+    }
+
     void voronoi_path::setLocalVertices(const std::vector<GraphNode> &vertices)
     {
+        //Vertices are sites of the diagram, graph has to be regenerated when they move
+        if (vertices.size() != local_vertices.size())
+            graph_stale = true;
+
+        for (int i = 0; i < vertices.size() && !graph_stale; ++i)
+        {
+            if (vertices[i].x != local_vertices[i].x || vertices[i].y != local_vertices[i].y)
+                graph_stale = true;
+        }
+
         local_vertices = vertices;
     }
 
@@ -26,360 +72,1311 @@ namespace voronoi_path
         return id++;
     }
 
-    std::vector<std::complex<double>> voronoi_path::findObstacleCentroids()
+    const std::vector<std::complex<double>> &voronoi_path::findObstacleCentroids()
     {
-        if (map_ptr->data.size() != 0)
+        if (!map_ptr->empty())
         {
             Profiler profiler;
-            cv::Mat cv_map = cv::Mat(map_ptr->data).reshape(0, map_ptr->height);
-            cv_map.convertTo(cv_map, CV_8UC1);
+            const MapRect &window = planning_window;
 
-            //Downscale to increase contour finding speed
-            cv::resize(cv_map, cv_map, cv::Size(), open_cv_scale, open_cv_scale, cv::INTER_AREA);
+            //Relabel the whole window when it moved or thresholds changed, otherwise only around tiles whose costs changed
+            MapRect region;
+            if (window != obstacles_window || collision_threshold != obstacles_threshold || min_obstacle_area != obstacles_min_area ||
+                filter_obstacle_sites != obstacles_filter_sites)
+            {
+                region = window;
+                obstacles_window = window;
+                obstacles_threshold = collision_threshold;
+                obstacles_min_area = min_obstacle_area;
+                obstacles_filter_sites = filter_obstacle_sites;
+            }
 
-            //Flip and transpose because image from map_server and actual map orientation is different
-            cv::flip(cv_map, cv_map, 1);
-            cv::transpose(cv_map, cv_map);
-            cv::flip(cv_map, cv_map, 1);
-            if (print_timings)
-                profiler.print("findObstacleCentroids copy map data");
+            else
+            {
+                int tile_size = 1 << TILE_SHIFT;
+                for (const auto &tile : changed_tiles)
+                    region = region.unite(MapRect((tile % tile_cols) * tile_size, (tile / tile_cols) * tile_size, tile_size, tile_size).intersect(window));
+            }
 
-            std::vector<std::vector<cv::Point>> contours;
-            std::vector<cv::Vec4i> hierarchy;
-            cv::Canny(cv_map, cv_map, 50, 150, 3);
-            cv::findContours(cv_map, contours, hierarchy, cv::RETR_LIST, cv::CHAIN_APPROX_NONE, cv::Point(0, 0));
-            centers = std::vector<std::complex<double>>(contours.size());
+            if (region.empty())
+                return centers;
 
-            for (int i = 0; i < contours.size(); ++i)
+            //Obstacles touching the region, including diagonally, may have changed. Their bounds grow the region until no
+            //other obstacle touches it, so components found in the region are complete
+            std::vector<bool> &affected = affected_obstacles;
+            affected.assign(obstacles.size(), false);
+            bool grown = true;
+            while (grown)
             {
-                //Find part of contour that lies on the inflation zone
-                for (int j = 0; j < contours[i].size(); ++j)
+                grown = false;
+                MapRect touching(region.x - 1, region.y - 1, region.width + 2, region.height + 2);
+                for (int i = 0; i < obstacles.size(); ++i)
                 {
-                    centers[i] = std::complex<double>(map_ptr->width - contours[i][j].y / open_cv_scale, map_ptr->height - contours[i][j].x / open_cv_scale);
-                    if (map_ptr->data[floor(centers[i].real()) + floor(centers[i].imag()) * map_ptr->width] > collision_threshold)
-                        break;
+                    if (affected[i] || !obstacles[i].bounds.intersects(touching))
+                        continue;
 
-                    if (j == contours[i].size() - 1)
-                    {
-                        std::cout << "WARN: Could not find point on contour " << j << " which lies on the obstacle's inflation zone, path finding may not produce";
-                        std::cout << " paths that are strictly in different homotopy classes\n ";
-                    }
+                    affected[i] = true;
+                    region = region.unite(obstacles[i].bounds);
+                    grown = true;
                 }
             }
 
-            double a = (centers.size() - 1) / 2.0;
-            double b = a;
-            obs_coeff.clear();
-            obs_coeff.resize(centers.size(), std::complex<double>(1, 1));
+            std::vector<Obstacle> &found = found_obstacles;
+            labelObstacles(region, found);
 
-            std::complex<double> from_begin(1, 1);
-            std::complex<double> from_end(1, 1);
-
-            //Scale down centers used for calculating homotopy coefficients to prevent overflow of double
-            double max = map_ptr->width > map_ptr->height ? map_ptr->width : map_ptr->height;
-            auto scaled_centers(centers);
-            for (auto &centers : scaled_centers)
-                centers /= max;
+            if (print_timings)
+                profiler.print("findObstacleCentroids label region");
 
-            for (int i = 0; i < scaled_centers.size(); ++i)
+            //Obstacles keep their ID while their first cell stays the same
+            affected_cells.clear();
+            for (int i = 0; i < obstacles.size(); ++i)
             {
-                obs_coeff[i] *= from_begin;
-                from_begin *= scaled_centers[i];
+                if (affected[i])
+                    affected_cells.emplace_back(hash(obstacles[i].point.real(), obstacles[i].point.imag()), i);
+            }
 
-                obs_coeff[scaled_centers.size() - i - 1] *= from_end;
-                from_end *= scaled_centers[scaled_centers.size() - i - 1];
-                if (std::isnan(obs_coeff[i].real()) || std::isnan(obs_coeff[i].imag()))
+            std::sort(affected_cells.begin(), affected_cells.end());
+            std::vector<Obstacle> &added = added_obstacles;
+            added.clear();
+            for (auto &obstacle : found)
+            {
+                uint64_t cell = hash(obstacle.point.real(), obstacle.point.imag());
+                auto cell_it = std::lower_bound(affected_cells.begin(), affected_cells.end(), std::make_pair(cell, 0));
+                if (cell_it != affected_cells.end() && cell_it->first == cell)
                 {
-                    std::cout << "Obstacle coefficients calculation produced NaN value, unique homotopy class exploration";
-                    std::cout << "will not work properly\n ";
+                    obstacles[cell_it->second].bounds = obstacle.bounds;
+                    obstacles[cell_it->second].area = obstacle.area;
+                    affected[cell_it->second] = false;
+                    continue;
                 }
+
+                obstacle.id = next_obstacle_id++;
+                added.push_back(obstacle);
+            }
+
+            //Affected obstacles that were not found again were removed or merged into another obstacle. New obstacles have
+            //the highest IDs, appending them keeps obstacles in ascending ID order
+            int num_removed = 0;
+            std::vector<Obstacle> &remaining = remaining_obstacles;
+            remaining.clear();
+            for (int i = 0; i < obstacles.size(); ++i)
+            {
+                if (affected[i])
+                    ++num_removed;
+
+                else
+                    remaining.push_back(obstacles[i]);
+            }
+
+            remaining.insert(remaining.end(), added.begin(), added.end());
+            obstacles.swap(remaining);
+
+            //Only significant obstacles are used for homotopy classes
+            double cell_area = map_ptr->resolution * map_ptr->resolution;
+            int num_insignificant = 0;
+            for (auto &obstacle : obstacles)
+            {
+                obstacle.significant = static_cast<double>(obstacle.bounds.width) * obstacle.bounds.height * cell_area >= min_obstacle_area;
+                if (!obstacle.significant)
+                    ++num_insignificant;
             }
 
+            updateHomotopyObstacles();
+            updateIgnoredSites();
+
             if (print_timings)
-                profiler.print("findObstacleCentroids find contour");
+            {
+                std::cout << "findObstacleCentroids " << obstacles.size() << " obstacles, " << added.size() << " added, " << num_removed
+                          << " removed, " << num_insignificant << " insignificant (" << num_insignificant * 100.0 / std::max<size_t>(obstacles.size(), 1)
+                          << "%) dropped from homotopy classes" << (filter_obstacle_sites ? " and sites\n" : "\n");
+                profiler.print("findObstacleCentroids match obstacles and update classes");
+            }
         }
 
         return centers;
     }
 
-    std::vector<jcv_point> voronoi_path::fillOccupancyVector(const int &start_index, const int &num_pixels)
+    void voronoi_path::labelObstacles(const MapRect &region, std::vector<Obstacle> &found)
     {
-        std::vector<jcv_point> points_vec;
-        for (int i = start_index; i < start_index + num_pixels; i += (pixels_to_skip + 1))
+        //Label row strips in parallel, runs of each strip are in row-major order
+        ThreadPool &pool = getThreadPool();
+        int num_tasks = std::max(1, std::min(pool.size(), region.height));
+        int num_rows = region.height / num_tasks;
+        if (obstacle_strips.size() < num_tasks)
+            obstacle_strips.resize(num_tasks);
+
+        auto label_strip = [&](int task) {
+            //Last task takes all remaining rows
+            int rows = task == num_tasks - 1 ? region.height - num_rows * (num_tasks - 1) : num_rows;
+            labelObstacleStrip(region, region.y + task * num_rows, rows, obstacle_strips[task]);
+        };
+
+        try
+        {
+            //Captures are kept small enough for std::function to store them without allocating
+            pool.parallelFor(0, num_tasks, [&label_strip](int task) {
+                label_strip(task);
+            });
+        }
+        catch (const std::exception &e)
+        {
+            std::cout << "Exception occurred while labelling obstacles, " << e.what() << std::endl;
+            return;
+        }
+
+        //Join strips into one set of runs, global index of a run is its strip's offset plus its index in the strip
+        std::vector<int> &strip_offsets = obstacle_strip_offsets;
+        strip_offsets.assign(num_tasks + 1, 0);
+        for (int task = 0; task < num_tasks; ++task)
+            strip_offsets[task + 1] = strip_offsets[task] + obstacle_strips[task].runs.size();
+
+        obstacle_parents.resize(strip_offsets[num_tasks]);
+        for (int task = 0; task < num_tasks; ++task)
+        {
+            const ObstacleStrip &strip = obstacle_strips[task];
+            for (int i = 0; i < strip.parents.size(); ++i)
+                obstacle_parents[strip_offsets[task] + i] = strip.parents[i] + strip_offsets[task];
+        }
+
+        //Runs in the last row of a strip and the first row of the next strip that touch belong to the same obstacle
+        for (int task = 0; task + 1 < num_tasks; ++task)
         {
-            //Occupied
-            if (map_ptr->data[i] >= occupancy_threshold)
+            const std::vector<ObstacleRun> &upper = obstacle_strips[task].runs;
+            const std::vector<ObstacleRun> &lower = obstacle_strips[task + 1].runs;
+            int seam = region.y + (task + 1) * num_rows;
+            int i = upper.size();
+            while (i > 0 && upper[i - 1].y == seam - 1)
+                --i;
+
+            for (int j = 0; j < lower.size() && lower[j].y == seam; ++j)
             {
-                jcv_point temp_point;
-                temp_point.x = i % map_ptr->width;
-                temp_point.y = static_cast<int>(i / map_ptr->width);
+                //Both rows are sorted by x, skip upper runs that end before this lower run can touch them
+                while (i < upper.size() && upper[i].x1 < lower[j].x0)
+                    ++i;
 
-                points_vec.push_back(temp_point);
+                for (int k = i; k < upper.size() && upper[k].x0 <= lower[j].x1; ++k)
+                    unionRoots(obstacle_parents, strip_offsets[task] + k, strip_offsets[task + 1] + j);
             }
         }
 
-        return points_vec;
+        //Roots are the first run of their obstacle, the center of their first cell lies inside the obstacle. Cell centers also
+        //keep points off the map origin. Roots come before the other runs of their obstacle, so bounds can be grown in one pass
+        std::vector<int> &root_obstacle = obstacle_roots;
+        root_obstacle.assign(strip_offsets[num_tasks], -1);
+        found.clear();
+        for (int task = 0; task < num_tasks; ++task)
+        {
+            const std::vector<ObstacleRun> &runs = obstacle_strips[task].runs;
+            for (int i = 0; i < runs.size(); ++i)
+            {
+                MapRect run_rect(runs[i].x0, runs[i].y, runs[i].x1 - runs[i].x0, 1);
+                int root = findRoot(obstacle_parents, strip_offsets[task] + i);
+                if (root == strip_offsets[task] + i)
+                {
+                    root_obstacle[root] = found.size();
+                    found.emplace_back();
+                    found.back().point = std::complex<double>(runs[i].x0 + 0.5, runs[i].y + 0.5);
+                    found.back().bounds = run_rect;
+                    found.back().area = run_rect.width;
+                }
+
+                else
+                {
+                    Obstacle &obstacle = found[root_obstacle[root]];
+                    obstacle.bounds = obstacle.bounds.unite(run_rect);
+                    obstacle.area += run_rect.width;
+                }
+            }
+        }
     }
 
-    bool voronoi_path::mapToGraph(Map *map_ptr_)
+    void voronoi_path::updateIgnoredSites()
     {
-        Profiler complete_profiler;
-        map_ptr = map_ptr_;
+        for (const auto &word : ignored_site_words)
+            ignored_sites[word] = 0;
 
-        //Get centroids after map has been updated
-        findObstacleCentroids();
+        ignored_site_words.clear();
+        if (!filter_obstacle_sites)
+            return;
 
-        //Lock mutex to ensure adj_list is not being used
-        Profiler section_profiler;
-        std::lock_guard<std::mutex> lock(voronoi_mtx);
+        int words_per_row = (map_ptr->width + 63) >> 6;
+        if (ignored_sites.size() != static_cast<size_t>(words_per_row) * map_ptr->height)
+            ignored_sites.assign(static_cast<size_t>(words_per_row) * map_ptr->height, 0);
 
-        if (print_timings)
-            section_profiler.print("mapToGraph lock duration");
+        //Flood fill insignificant obstacles from their first cell, they are small so cells are visited one by one
+        std::vector<std::pair<int, int>> &stack = fill_stack;
+        for (const auto &obstacle : obstacles)
+        {
+            if (obstacle.significant)
+                continue;
 
-        int size = map_ptr->data.size();
-        if (size == 0)
-            return false;
+            stack.assign(1, std::make_pair(static_cast<int>(obstacle.point.real()), static_cast<int>(obstacle.point.imag())));
+            while (!stack.empty())
+            {
+                int x = stack.back().first;
+                int y = stack.back().second;
+                stack.pop_back();
 
-        //Set bottom left and top right for use during homotopy check
-        BL = std::complex<double>(0, 0);
-        TR = std::complex<double>(map_ptr->width - 1, map_ptr->height - 1);
+                int word = y * words_per_row + (x >> 6);
+                uint64_t bit = 1ULL << (x & 63);
+                if (ignored_sites[word] & bit)
+                    continue;
 
-        // Loop through map to find occupied cells
-        int num_threads = std::thread::hardware_concurrency();
-        std::vector<std::future<std::vector<jcv_point>>> future_vector;
-        future_vector.reserve(num_threads - 1);
+                if (!ignored_sites[word])
+                    ignored_site_words.push_back(word);
 
-        int num_pixels = floor(size / num_threads);
-        int start_pixel = 0;
+                ignored_sites[word] |= bit;
+                for (int dy = -1; dy <= 1; ++dy)
+                {
+                    for (int dx = -1; dx <= 1; ++dx)
+                    {
+                        int nx = x + dx;
+                        int ny = y + dy;
+                        if (obstacle.bounds.contains(nx, ny) && map_ptr->getCost(nx, ny) > collision_threshold &&
+                            !(ignored_sites[ny * words_per_row + (nx >> 6)] & (1ULL << (nx & 63))))
+                            stack.emplace_back(nx, ny);
+                    }
+                }
+            }
+        }
+    }
 
-        for (int i = 0; i < num_threads - 1; ++i)
+    bool voronoi_path::updateHomotopyObstacles()
+    {
+        //Obstacles used before the update, in ascending ID order like obstacles
+        previous_center_ids.swap(center_ids);
+        previous_centers.swap(centers);
+
+        //Coefficients only depend on IDs, so only obstacles entering or leaving the set change homotopy classes
+        std::vector<Obstacle> &entered = entered_obstacles;
+        std::vector<Obstacle> &left = left_obstacles;
+        entered.clear();
+        left.clear();
+        centers.clear();
+        obs_coeff.clear();
+        center_ids.clear();
+        center_x.clear();
+        center_y.clear();
+        center_sizes.clear();
+        int previous = 0;
+        for (const auto &obstacle : obstacles)
         {
-            start_pixel = i * num_pixels;
-            future_vector.emplace_back(std::async(std::launch::async, &voronoi_path::fillOccupancyVector, this, start_pixel, num_pixels));
-        }
+            if (!obstacle.significant || !inHomotopyCorridor(obstacle.point))
+                continue;
 
-        //For last thread, take all remaining pixels
-        //This current thread is the nth thread
-        std::vector<jcv_point> points_vec;
-        points_vec = fillOccupancyVector((num_threads - 1) * num_pixels, size - num_pixels * (num_threads - 1));
+            centers.push_back(obstacle.point);
+            obs_coeff.push_back(obstacleCoefficient(obstacle.id));
+            center_ids.push_back(obstacle.id);
+            center_x.push_back(obstacle.point.real());
+            center_y.push_back(obstacle.point.imag());
+            center_sizes.push_back(std::min(obstacle.bounds.width, obstacle.bounds.height));
 
-        for (int i = 0; i < future_vector.size(); ++i)
-        {
-            try
-            {
-                future_vector[i].wait();
-                std::vector<jcv_point> temp_vec = future_vector[i].get();
-                points_vec.insert(points_vec.end(), temp_vec.begin(), temp_vec.end());
-            }
-            catch (const std::exception &e)
+            //Both lists are sorted by ID, previous obstacles with lower IDs left
+            for (; previous < previous_center_ids.size() && previous_center_ids[previous] < obstacle.id; ++previous)
             {
-                std::cout << "Exception occurred with future, " << e.what() << std::endl;
-                return false;
+                left.push_back(Obstacle());
+                left.back().id = previous_center_ids[previous];
+                left.back().point = previous_centers[previous];
             }
-        }
 
-        //Add vertices that correspond to local costmap 4 corners
-        for (int i = 0; i < local_vertices.size(); ++i)
-        {
-            jcv_point temp_point;
-            temp_point.x = local_vertices[i].x;
-            temp_point.y = local_vertices[i].y;
-            points_vec.push_back(temp_point);
-        }
+            if (previous < previous_center_ids.size() && previous_center_ids[previous] == obstacle.id)
+                ++previous;
 
-        int occupied_points = points_vec.size();
-        jcv_point *points = (jcv_point *)malloc(occupied_points * sizeof(jcv_point));
+            else
+                entered.push_back(obstacle);
+        }
 
-        if (!points)
+        for (; previous < previous_center_ids.size(); ++previous)
         {
-            std::cout << "Failed to allocate memory for points array" << std::endl;
-            return false;
+            left.push_back(Obstacle());
+            left.back().id = previous_center_ids[previous];
+            left.back().point = previous_centers[previous];
         }
 
-        for (int i = 0; i < occupied_points; ++i)
-            points[i] = points_vec[i];
-
-        if (print_timings)
-            section_profiler.print("mapToGraph loop map points");
+        updatePathClasses(left, entered);
+        return !left.empty() || !entered.empty();
+    }
 
-        //Set the minimum and maximum bounds for voronoi diagram. Follows size of map
-        jcv_rect rect;
-        rect.min.x = 0;
-        rect.min.y = 0;
-        rect.max.x = map_ptr->width - 1;
-        rect.max.y = map_ptr->height - 1;
+    bool voronoi_path::inHomotopyCorridor(const std::complex<double> &point)
+    {
+        if (homotopy_corridor_ratio <= 0 || !has_homotopy_corridor)
+            return true;
 
-        jcv_diagram diagram;
-        memset(&diagram, 0, sizeof(jcv_diagram));
+        std::complex<double> start(homotopy_corridor_start.x, homotopy_corridor_start.y);
+        std::complex<double> end(homotopy_corridor_end.x, homotopy_corridor_end.y);
 
-        //Tried diagram generation in another thread, does not help
-        jcv_diagram_generate(occupied_points, points, &rect, 0, &diagram);
+        //Ratios below 1 give an empty ellipse, the segment between start and goal is the smallest one
+        return std::abs(point - start) + std::abs(point - end) <= std::max(homotopy_corridor_ratio, 1.0) * std::abs(end - start);
+    }
 
-        //Get edges from voronoi diagram
-        std::vector<const jcv_edge *> edge_vector;
-        const jcv_edge *edges = jcv_diagram_get_edges(&diagram);
-        while (edges)
-        {
-            edge_vector.push_back(edges);
-            edges = jcv_diagram_get_next_edge(edges);
-        }
+    void voronoi_path::setHomotopyCorridor(const GraphNode &start, const GraphNode &end)
+    {
+        //All obstacles are already used
+        if (homotopy_corridor_ratio <= 0 && !has_homotopy_corridor)
+            return;
 
-        if (print_timings)
-            section_profiler.print("mapToGraph generating edges");
+        has_homotopy_corridor = homotopy_corridor_ratio > 0;
+        homotopy_corridor_start = start;
+        homotopy_corridor_end = end;
 
-        //Remove edge vertices that are in obtacle
-        removeObstacleVertices(edge_vector);
+        //Edge terms only need to be updated when obstacles entered or left the corridor
+        Profiler profiler;
+        if (!updateHomotopyObstacles())
+            return;
 
-        //Remove edges that pass through obstacle
-        removeCollisionEdges(edge_vector);
+        updateEdgeHomotopy();
 
         if (print_timings)
-            section_profiler.print("mapToGraph clearing edges");
+        {
+            std::cout << "setHomotopyCorridor " << centers.size() << " obstacles used for homotopy classes" << std::endl;
+            profiler.print("setHomotopyCorridor update obstacles and edge homotopy");
+        }
+    }
 
-        //Convert edges to adjacency list
-        edgesToAdjacency(edge_vector);
+    std::complex<double> voronoi_path::obstacleCoefficient(uint32_t id)
+    {
+        //Consecutive IDs are a golden angle apart, so coefficients of any set of obstacles are spread around the unit circle.
+        //IDs that differ by a Fibonacci number still get close coefficients, |c(i) - c(i + 233)| is about 0.012, so paths
+        //weaving oppositely between two such obstacles have H-signatures within a few percent of each other
+        return std::polar(1.0, id * 2.39996322972865332);
+    }
 
-        if (print_timings)
+    void voronoi_path::pathCrossings(const std::vector<GraphNode> &path, const double *center_x, const double *center_y, int num_centers, double *crossings)
+    {
+        std::fill(crossings, crossings + num_centers, 0);
+        for (int i = 1; i < path.size(); ++i)
+            segmentCrossings(path[i - 1], path[i], center_x, center_y, num_centers, crossings);
+    }
+
+    void voronoi_path::segmentCrossings(const GraphNode &from, const GraphNode &to, const double *center_x, const double *center_y, int num_centers, double *crossings)
+    {
+        double ax = from.x;
+        double ay = from.y;
+        double bx = to.x;
+        double by = to.y;
+
+        //The edge crosses the cut left of the center if the sign of the cross product matches the direction it crosses
+        //y = center_y in. Compare masks are and-ed with 1.0 to count in the same lanes as the coordinates
+        int j = 0;
+#if defined(__AVX2__)
+        const __m256d ax_4 = _mm256_set1_pd(ax), ay_4 = _mm256_set1_pd(ay), bx_4 = _mm256_set1_pd(bx), by_4 = _mm256_set1_pd(by);
+        const __m256d zero_4 = _mm256_setzero_pd(), one_4 = _mm256_set1_pd(1.0);
+        for (; j + 4 <= num_centers; j += 4)
         {
-            section_profiler.print("mapToGraph convert edges to adjacency");
-            complete_profiler.print("mapToGraph total time");
+            __m256d cx = _mm256_loadu_pd(center_x + j);
+            __m256d cy = _mm256_loadu_pd(center_y + j);
+            __m256d uy = _mm256_sub_pd(ay_4, cy);
+            __m256d vy = _mm256_sub_pd(by_4, cy);
+            __m256d cross = _mm256_sub_pd(_mm256_mul_pd(_mm256_sub_pd(ax_4, cx), vy), _mm256_mul_pd(uy, _mm256_sub_pd(bx_4, cx)));
+            __m256d down = _mm256_and_pd(_mm256_and_pd(_mm256_cmp_pd(uy, zero_4, _CMP_GE_OQ), _mm256_cmp_pd(vy, zero_4, _CMP_LT_OQ)),
+                                         _mm256_cmp_pd(cross, zero_4, _CMP_GT_OQ));
+            __m256d up = _mm256_and_pd(_mm256_and_pd(_mm256_cmp_pd(uy, zero_4, _CMP_LT_OQ), _mm256_cmp_pd(vy, zero_4, _CMP_GE_OQ)),
+                                       _mm256_cmp_pd(cross, zero_4, _CMP_LT_OQ));
+            __m256d delta = _mm256_sub_pd(_mm256_and_pd(down, one_4), _mm256_and_pd(up, one_4));
+            _mm256_storeu_pd(crossings + j, _mm256_add_pd(_mm256_loadu_pd(crossings + j), delta));
+        }
+#endif
+#if defined(__SSE2__)
+        const __m128d ax_2 = _mm_set1_pd(ax), ay_2 = _mm_set1_pd(ay), bx_2 = _mm_set1_pd(bx), by_2 = _mm_set1_pd(by);
+        const __m128d zero_2 = _mm_setzero_pd(), one_2 = _mm_set1_pd(1.0);
+        for (; j + 2 <= num_centers; j += 2)
+        {
+            __m128d cx = _mm_loadu_pd(center_x + j);
+            __m128d cy = _mm_loadu_pd(center_y + j);
+            __m128d uy = _mm_sub_pd(ay_2, cy);
+            __m128d vy = _mm_sub_pd(by_2, cy);
+            __m128d cross = _mm_sub_pd(_mm_mul_pd(_mm_sub_pd(ax_2, cx), vy), _mm_mul_pd(uy, _mm_sub_pd(bx_2, cx)));
+            __m128d down = _mm_and_pd(_mm_and_pd(_mm_cmpge_pd(uy, zero_2), _mm_cmplt_pd(vy, zero_2)), _mm_cmpgt_pd(cross, zero_2));
+            __m128d up = _mm_and_pd(_mm_and_pd(_mm_cmplt_pd(uy, zero_2), _mm_cmpge_pd(vy, zero_2)), _mm_cmplt_pd(cross, zero_2));
+            __m128d delta = _mm_sub_pd(_mm_and_pd(down, one_2), _mm_and_pd(up, one_2));
+            _mm_storeu_pd(crossings + j, _mm_add_pd(_mm_loadu_pd(crossings + j), delta));
+        }
+#endif
+        //Scalar fallback, also takes the centers left over at the end
+        for (; j < num_centers; ++j)
+        {
+            double uy = ay - center_y[j];
+            double vy = by - center_y[j];
+            double cross = (ax - center_x[j]) * vy - uy * (bx - center_x[j]);
+            crossings[j] += (uy >= 0 && vy < 0 && cross > 0) - (uy < 0 && vy >= 0 && cross < 0);
         }
+    }
 
-        jcv_diagram_free(&diagram);
-        free(points);
-        return true;
+    std::complex<double> voronoi_path::pathHomotopy(const GraphNode &start, const GraphNode &end, const std::complex<double> &center, double crossings)
+    {
+        std::complex<double> from = std::complex<double>(start.x, start.y) - center;
+        std::complex<double> to = std::complex<double>(end.x, end.y) - center;
+        return std::complex<double>(std::log(std::abs(to)) - std::log(std::abs(from)), std::arg(to) - std::arg(from) + 2 * M_PI * crossings);
     }
 
-    bool voronoi_path::edgesToAdjacency(const std::vector<const jcv_edge *> &edge_vector)
+    void voronoi_path::updatePathClasses(const std::vector<Obstacle> &removed, const std::vector<Obstacle> &added)
     {
-        //Reset all variables
-        adj_list.clear();
-        node_inf.clear();
+        if (removed.empty() && added.empty())
+            return;
 
-        std::unordered_map<uint32_t, int> hash_index_map;
-        for (int i = 0; i < edge_vector.size(); ++i)
+        for (auto &path : previous_paths)
         {
-            //Get hash for both vertices of the current edge
-            std::vector<uint32_t> hash_vec = {hash(edge_vector[i]->pos[0].x, edge_vector[i]->pos[0].y),
-                                              hash(edge_vector[i]->pos[1].x, edge_vector[i]->pos[1].y)};
-            int node_index[] = {-1, -1};
+            if (!path.has_h_class || path.path.size() < 2)
+                continue;
 
-            //Check if each node is already in the map
-            for (int j = 0; j < 2; ++j)
+            for (const auto &obstacle : removed)
             {
-                auto node_it = hash_index_map.find(hash_vec[j]);
+                double center_x = obstacle.point.real();
+                double center_y = obstacle.point.imag();
+                double crossings;
+                pathCrossings(path.path, &center_x, &center_y, 1, &crossings);
+                path.h_class.h_signature -= pathHomotopy(path.path.front(), path.path.back(), obstacle.point, crossings) * obstacleCoefficient(obstacle.id);
+            }
 
-                //Node already exists
-                if (node_it != hash_index_map.end())
-                    node_index[j] = node_it->second;
+            for (const auto &obstacle : added)
+            {
+                double center_x = obstacle.point.real();
+                double center_y = obstacle.point.imag();
+                double crossings;
+                pathCrossings(path.path, &center_x, &center_y, 1, &crossings);
+                path.h_class.h_signature += pathHomotopy(path.path.front(), path.path.back(), obstacle.point, crossings) * obstacleCoefficient(obstacle.id);
+            }
 
-                //Node doesn't exist, add new node to adjacency list & info vector, and respective hash and node index to map
-                else
-                {
-                    node_index[j] = adj_list.size();
-                    node_inf.emplace_back(edge_vector[i]->pos[j].x, edge_vector[i]->pos[j].y);
-                    adj_list.push_back(std::vector<int>());
-                    hash_index_map.insert(std::pair<uint32_t, int>(hash_vec[j], node_index[j]));
-                }
+            //Windings of other obstacles stay the same, entries stay sorted by ID
+            std::vector<std::pair<uint32_t, int>> &windings = path.h_class.windings;
+            for (const auto &obstacle : removed)
+            {
+                auto winding_it = std::lower_bound(windings.begin(), windings.end(), std::make_pair(obstacle.id, std::numeric_limits<int>::min()));
+                if (winding_it != windings.end() && winding_it->first == obstacle.id)
+                    windings.erase(winding_it);
             }
 
-            //Once both node indices are found, add edge between the two nodes if they aren't the same node
-            if (node_index[0] != node_index[1])
+            for (const auto &obstacle : added)
             {
-                adj_list[node_index[0]].push_back(node_index[1]);
-                adj_list[node_index[1]].push_back(node_index[0]);
+                int winding = windingNumber(path.path, obstacle.point);
+                if (winding != 0)
+                    windings.insert(std::lower_bound(windings.begin(), windings.end(), std::make_pair(obstacle.id, winding)), std::make_pair(obstacle.id, winding));
             }
         }
+    }
 
-        //Connect single edges to nearby node if <= node_connection_threshold_pix pixel distance
-        std::vector<int> unconnected_nodes;
-        int threshold = pow(node_connection_threshold_pix, 2);
-        for (int node_num = 0; node_num < adj_list.size(); ++node_num)
+    void voronoi_path::labelObstacleStrip(const MapRect &region, int start_row, int num_rows, ObstacleStrip &strip)
+    {
+        const std::vector<uint64_t> *collision_bits = getBitplane(collision_threshold);
+        int first_word = region.x >> 6;
+        int last_word = (region.x + region.width - 1) >> 6;
+        std::vector<ObstacleRun> &runs = strip.runs;
+        std::vector<int> &parents = strip.parents;
+        runs.clear();
+        parents.clear();
+
+        int prev_row_begin = 0;
+        for (int y = start_row; y < start_row + num_rows; ++y)
         {
-            //Singly connected node
-            if (adj_list[node_num].size() == 1)
+            int row_begin = runs.size();
+            bool run_open = false;
+            for (int word = first_word; word <= last_word; ++word)
             {
-                //Check through all node_inf to see if there are any within distance threshold
-                for (int j = 0; j < node_inf.size(); ++j)
+                int x0 = word << 6;
+                uint64_t word_bits = occupiedCells(y, word, collision_threshold, collision_bits) & columnMask(x0, region.x, region.x + region.width);
+                uint64_t bits = word_bits;
+                while (bits)
                 {
-                    //If the node being checked is itself or is already connected to the checked node, new_adj_list[i] only has 1 element
-                    if (j == node_num || adj_list[node_num].back() == j)
-                        continue;
+                    int start = __builtin_ctzll(bits);
+                    uint64_t clear = ~bits & (~0ULL << start);
+                    int end = clear ? __builtin_ctzll(clear) : 64;
 
-                    double dist = pow(node_inf[j].x - node_inf[node_num].x, 2) + pow(node_inf[j].y - node_inf[node_num].y, 2);
-                    if (dist <= threshold)
+                    //Runs continue across words when the previous word ended set
+                    if (run_open && start == 0)
+                        runs.back().x1 = x0 + end;
+
+                    else
                     {
-                        adj_list[node_num].push_back(j);
-                        adj_list[j].push_back(node_num);
-                        break;
+                        runs.push_back(ObstacleRun{y, x0 + start, x0 + end});
+                        parents.push_back(runs.size() - 1);
                     }
 
-                    //Remember nodes that were unconnected to trim later
-                    if(j == node_inf.size() - 1)
-                        unconnected_nodes.push_back(node_num);
+                    bits = end == 64 ? 0 : bits & (~0ULL << end);
                 }
+
+                run_open = word_bits >> 63;
             }
-        }
 
-        //Loop through all nodes that were unable to be connected for trimming
-        auto new_adj_list = adj_list;
-        double thresh = sqrt(lonely_branch_dist_threshold) / map_ptr->resolution;
-        for(const auto &node_num : unconnected_nodes)
-            removeExcessBranch(new_adj_list, thresh, node_num);
+            //Join with runs of the previous row that touch, including diagonally
+            if (y > start_row)
+            {
+                int i = prev_row_begin;
+                for (int j = row_begin; j < runs.size(); ++j)
+                {
+                    while (i < row_begin && runs[i].x1 < runs[j].x0)
+                        ++i;
 
-        adj_list = std::move(new_adj_list);
-        num_nodes = adj_list.size();
-        return true;
-    }
+                    for (int k = i; k < row_begin && runs[k].x0 <= runs[j].x1; ++k)
+                        unionRoots(parents, k, j);
+                }
+            }
 
-    std::vector<std::vector<int>> voronoi_path::getAdjList()
-    {
-        std::lock_guard<std::mutex> lock(voronoi_mtx);
-        return adj_list;
+            prev_row_begin = row_begin;
+        }
     }
 
-    std::vector<GraphNode> voronoi_path::getNodeInfo()
+    int voronoi_path::findRoot(std::vector<int> &parents, int a)
     {
-        std::lock_guard<std::mutex> lock(voronoi_mtx);
-        return node_inf;
+        while (parents[a] != a)
+        {
+            parents[a] = parents[parents[a]];
+            a = parents[a];
+        }
+
+        return a;
     }
 
-    std::vector<std::pair<double, int>> voronoi_path::getSortedNodeList(GraphNode position)
+    void voronoi_path::unionRoots(std::vector<int> &parents, int a, int b)
     {
-        sorted_node_list.clear();
-        double min_start_dist = std::numeric_limits<double>::infinity();
-
-        //Store list of distances to each node from current position
-        for (int i = 0; i < num_nodes; ++i)
-            sorted_node_list.emplace_back(pow(node_inf[i].x - position.x, 2) + pow(node_inf[i].y - position.y, 2), i);
+        a = findRoot(parents, a);
+        b = findRoot(parents, b);
+        if (a < b)
+            parents[b] = a;
 
-        //Sort list of nodes and distance
-        sort(sorted_node_list.begin(), sorted_node_list.end(), [](std::pair<double, int> &left, std::pair<double, int> &right) {
-            return left.first < right.first;
-        });
-        return sorted_node_list;
+        else if (b < a)
+            parents[a] = b;
     }
 
-    bool voronoi_path::getObstacleCentroids(std::vector<GraphNode> &centroids)
+    int voronoi_path::fillOccupancyVector(const int &start_row, const int &num_rows, jcv_point *points, SiteScratch &scratch)
     {
-        centroids.reserve(centers.size());
-        for (const auto &elem : centers)
-            centroids.emplace_back(elem.real(), elem.imag());
+        const std::vector<uint64_t> *occupancy_bits = getBitplane(occupancy_threshold - 1);
+        const MapRect &window = planning_window;
+        int first_word = window.x >> 6;
+        int num_words = ((window.x + window.width - 1) >> 6) - first_word + 1;
+
+        //Occupancy of rows above, at and below the current row. For boundary sites cells outside of the window count as
+        //occupied, so that obstacles cut by the window edge do not produce sites along it
+        std::vector<uint64_t> &window_columns = scratch.window_columns;
+        window_columns.resize(num_words);
+        for (int word = 0; word < num_words; ++word)
+            window_columns[word] = columnMask((first_word + word) << 6, window.x, window.x + window.width);
+
+        //Decimation keeps one site per block of cells, blocks are aligned to the map so sites do not move with the window
+        int block = siteBlockSize();
+        int first_block = window.x / block;
+        std::vector<char> &block_taken = scratch.block_taken;
+        block_taken.resize((window.x + window.width - 1) / block - first_block + 1);
+
+        std::vector<uint64_t> &above = scratch.above;
+        std::vector<uint64_t> &current = scratch.current;
+        std::vector<uint64_t> &below = scratch.below;
+        auto load_row = [&](int y, std::vector<uint64_t> &row) {
+            row.assign(num_words, ~0ULL);
+            if (y < window.y || y >= window.y + window.height)
+                return;
+
+            for (int word = 0; word < num_words; ++word)
+            {
+                row[word] = occupiedCells(y, first_word + word, occupancy_threshold - 1, occupancy_bits) | (boundary_sites ? ~window_columns[word] : 0);
 
-        return true;
-    }
+                //Cells of insignificant obstacles are treated as free
+                if (!ignored_site_words.empty())
+                    row[word] &= ~ignored_sites[y * ((map_ptr->width + 63) >> 6) + first_word + word];
+            }
+        };
 
-    std::vector<double> voronoi_path::getAllPathCosts()
-    {
-        return previous_path_costs;
-    }
+        if (boundary_sites)
+            load_row(start_row - 1, above);
 
-    bool voronoi_path::getEdges(std::vector<GraphNode> &edges)
-    {
-        std::lock_guard<std::mutex> lock(voronoi_mtx);
+        load_row(start_row, current);
 
-        // Total number is unknown, reserve minimum amount needed
-        edges.reserve(num_nodes);
+        int count = 0;
+        int step = pixels_to_skip + 1;
+        for (int y = start_row; y < start_row + num_rows; ++y)
+        {
+            if (boundary_sites)
+                load_row(y + 1, below);
+
+            if (block > 1 && (y == start_row || y % block == 0))
+                std::fill(block_taken.begin(), block_taken.end(), 0);
+
+            for (int word = 0; word < num_words; ++word)
+            {
+                uint64_t bits = current[word];
+
+                //Remove cells whose 4 neighbours are all occupied, leaving the obstacle boundary
+                if (boundary_sites)
+                {
+                    uint64_t left = (bits << 1) | (word > 0 ? current[word - 1] >> 63 : 1);
+                    uint64_t right = (bits >> 1) | (word < num_words - 1 ? current[word + 1] << 63 : 1ULL << 63);
+                    bits &= ~(above[word] & below[word] & left & right) & window_columns[word];
+                }
+
+                //Keep the first site found in each block, every other cell of the block is within site_tolerance of it
+                int x0 = (first_word + word) << 6;
+                if (block > 1)
+                {
+                    uint64_t remaining = bits;
+                    while (remaining)
+                    {
+                        int bit = __builtin_ctzll(remaining);
+                        remaining &= remaining - 1;
+                        char &taken = block_taken[(x0 + bit) / block - first_block];
+                        if (taken)
+                            bits &= ~(1ULL << bit);
+
+                        taken = 1;
+                    }
+                }
+
+                //Skipping follows the cell index, same as reading the map data in steps
+                else if (step > 1)
+                {
+                    uint64_t remaining = bits;
+                    while (remaining)
+                    {
+                        int bit = __builtin_ctzll(remaining);
+                        remaining &= remaining - 1;
+                        if ((static_cast<int64_t>(y) * map_ptr->width + x0 + bit) % step != 0)
+                            bits &= ~(1ULL << bit);
+                    }
+                }
+
+                if (!points)
+                {
+                    count += __builtin_popcountll(bits);
+                    continue;
+                }
+
+                //Compact set bits into points, coordinates come from the row and word counters
+                while (bits)
+                {
+                    points[count].x = x0 + __builtin_ctzll(bits);
+                    points[count].y = y;
+                    ++count;
+                    bits &= bits - 1;
+                }
+            }
+
+            if (boundary_sites)
+            {
+                std::swap(above, current);
+                std::swap(current, below);
+            }
+
+            else if (y + 1 < start_row + num_rows)
+                load_row(y + 1, current);
+        }
+
+        return count;
+    }
+
+    void voronoi_path::GenerationArena::reset()
+    {
+        //Merge blocks so that the next generation fits in one
+        if (blocks.size() > 1)
+        {
+            size_t total = 0;
+            for (const Block &block : blocks)
+                total += block.size;
+
+            blocks.clear();
+            blocks.resize(1);
+            blocks[0].data.reset(new char[total]);
+            blocks[0].size = total;
+        }
+
+        block_idx = 0;
+        used = 0;
+    }
+
+    void *voronoi_path::GenerationArena::allocate(size_t size)
+    {
+        //Keep allocations 16 byte aligned, same as malloc
+        size = (size + 15) & ~static_cast<size_t>(15);
+        while (block_idx < blocks.size() && blocks[block_idx].size - used < size)
+        {
+            ++block_idx;
+            used = 0;
+        }
+
+        if (block_idx == blocks.size())
+        {
+            blocks.emplace_back();
+            blocks.back().size = size < MIN_BLOCK_SIZE ? MIN_BLOCK_SIZE : size;
+            blocks.back().data.reset(new char[blocks.back().size]);
+            used = 0;
+        }
+
+        void *ptr = blocks[block_idx].data.get() + used;
+        used += size;
+        return ptr;
+    }
+
+    int voronoi_path::siteBlockSize()
+    {
+        if (site_tolerance <= 0 || map_ptr->resolution <= 0)
+            return 1;
+
+        //Cells of a square block are at most its diagonal apart
+        return std::max(1, static_cast<int>(std::floor(site_tolerance / (map_ptr->resolution * std::sqrt(2.0)))));
+    }
+
+    uint64_t voronoi_path::occupiedCells(int y, int word, int threshold, const std::vector<uint64_t> *plane)
+    {
+        int width = map_ptr->width;
+        int x0 = word << 6;
+        uint64_t bits = plane ? (*plane)[y * bitplane_words_per_row + word]
+                              : thresholdMask(map_ptr->cells() + y * width + x0, std::min(64, width - x0), threshold);
+
+        bits &= columnMask(x0, planning_window.x, planning_window.x + planning_window.width);
+
+        //Cells under the overlay are replaced with their composited cost
+        const MapRect &overlay_rect = map_ptr->overlay.rect;
+        if (y >= overlay_rect.y && y < overlay_rect.y + overlay_rect.height)
+        {
+            uint64_t overlay_bits = columnMask(x0, overlay_rect.x, overlay_rect.x + overlay_rect.width) & columnMask(x0, 0, width);
+            bits &= ~overlay_bits;
+            while (overlay_bits)
+            {
+                int bit = __builtin_ctzll(overlay_bits);
+                overlay_bits &= overlay_bits - 1;
+                if (map_ptr->getCost(x0 + bit, y) > threshold)
+                    bits |= 1ULL << bit;
+            }
+        }
+
+        return bits;
+    }
+
+    uint64_t voronoi_path::columnMask(int x0, int begin, int end)
+    {
+        begin = std::max(begin - x0, 0);
+        end = std::min(end - x0, 64);
+        if (end <= begin)
+            return 0;
+
+        uint64_t upto_end = end == 64 ? ~0ULL : (1ULL << end) - 1;
+        return upto_end & ~((1ULL << begin) - 1);
+    }
+
+    uint64_t voronoi_path::thresholdMask(const signed char *cells, int count, int threshold)
+    {
+        //Costs are signed chars, thresholds outside of that range compare the same for every cell
+        if (threshold >= std::numeric_limits<signed char>::max())
+            return 0;
+
+        if (threshold < std::numeric_limits<signed char>::min())
+            return count == 64 ? ~0ULL : (1ULL << count) - 1;
+
+        uint64_t mask = 0;
+        int i = 0;
+#if defined(__AVX2__)
+        const __m256i threshold_32 = _mm256_set1_epi8(static_cast<char>(threshold));
+        for (; i + 32 <= count; i += 32)
+        {
+            __m256i costs = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(cells + i));
+            uint32_t above = _mm256_movemask_epi8(_mm256_cmpgt_epi8(costs, threshold_32));
+            mask |= static_cast<uint64_t>(above) << i;
+        }
+#endif
+#if defined(__SSE2__)
+        const __m128i threshold_16 = _mm_set1_epi8(static_cast<char>(threshold));
+        for (; i + 16 <= count; i += 16)
+        {
+            __m128i costs = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cells + i));
+            uint32_t above = _mm_movemask_epi8(_mm_cmpgt_epi8(costs, threshold_16));
+            mask |= static_cast<uint64_t>(above) << i;
+        }
+#endif
+        //Scalar fallback, also takes the cells left over at the end of a row
+        for (; i < count; ++i)
+            mask |= static_cast<uint64_t>(cells[i] > threshold) << i;
+
+        return mask;
+    }
+
+    bool voronoi_path::mapToGraph(Map *map_ptr_)
+    {
+        Profiler complete_profiler;
+        map_ptr = map_ptr_;
+        graph_updated = false;
+
+        int size = map_ptr->size();
+        if (size == 0)
+            return false;
+
+        //Region of interest is enabled, nothing is built until a start and goal are given
+        MapRect window = getPlanningWindow();
+        if (window.empty())
+            return false;
+
+        Profiler section_profiler;
+        {
+            std::lock_guard<std::mutex> lock(voronoi_mtx);
+            bool map_changed = updateTileHashes(window);
+            refreshMapCaches(window);
+            planning_window = window;
+
+            //Nothing changed since the previous graph, dirty regions were only consumed
+            if (!map_changed && !graph_stale)
+            {
+                if (print_timings)
+                    section_profiler.print("mapToGraph map unchanged, skipped");
+
+                return true;
+            }
+        }
+
+        if (print_timings)
+            section_profiler.print("mapToGraph hash tiles and refresh caches");
+
+        //Get centroids after map has been updated
+        findObstacleCentroids();
+
+        //Lock mutex to ensure adj_list is not being used
+        section_profiler = Profiler();
+        std::lock_guard<std::mutex> lock(voronoi_mtx);
+
+        if (print_timings)
+            section_profiler.print("mapToGraph lock duration");
+
+        //Set bottom left and top right for use during homotopy check
+        BL = std::complex<double>(window.x, window.y);
+        TR = std::complex<double>(window.x + window.width - 1, window.y + window.height - 1);
+
+        // Loop through map to find occupied cells, each task takes a band of rows
+        // First pass counts sites of each band, second pass writes them at the band's offset into a single array
+        ThreadPool &pool = getThreadPool();
+        int num_tasks = std::max(1, std::min(pool.size(), window.height));
+        int num_rows = window.height / num_tasks;
+        site_offsets.assign(num_tasks + 1, 0);
+        if (site_scratch.size() < num_tasks)
+            site_scratch.resize(num_tasks);
+
+        int block = siteBlockSize();
+        auto band_start = [&](int task) {
+            //Bands start on decimation block rows so that no block is split between tasks, last task ends at the window
+            if (task == 0)
+                return window.y;
+
+            if (task == num_tasks)
+                return window.y + window.height;
+
+            return std::max(window.y, (window.y + task * num_rows) / block * block);
+        };
+        auto fill_band = [&](int task, jcv_point *band_points) {
+            int start_row = band_start(task);
+            return fillOccupancyVector(start_row, band_start(task + 1) - start_row, band_points, site_scratch[task]);
+        };
+
+        try
+        {
+            //Captures are kept small enough for std::function to store them without allocating
+            pool.parallelFor(0, num_tasks, [this, &fill_band](int task) {
+                site_offsets[task + 1] = fill_band(task, nullptr);
+            });
+
+            for (int task = 0; task < num_tasks; ++task)
+                site_offsets[task + 1] += site_offsets[task];
+
+            //Only grows, capacity is kept when fewer sites are found
+            site_buffer.resize(site_offsets[num_tasks] + local_vertices.size());
+            pool.parallelFor(0, num_tasks, [this, &fill_band](int task) {
+                fill_band(task, site_buffer.data() + site_offsets[task]);
+            });
+        }
+        catch (const std::exception &e)
+        {
+            std::cout << "Exception occurred while finding occupied cells, " << e.what() << std::endl;
+
+            //Obstacles were already updated, edge crossings of the previous graph still index the old centers
+            updateEdgeHomotopy();
+            graph_stale = true;
+            return false;
+        }
+
+        //Add vertices that correspond to local costmap 4 corners
+        int occupied_points = site_offsets[num_tasks];
+        for (int i = 0; i < local_vertices.size(); ++i)
+        {
+            if (!window.contains(floor(local_vertices[i].x), floor(local_vertices[i].y)))
+                continue;
+
+            site_buffer[occupied_points].x = local_vertices[i].x;
+            site_buffer[occupied_points].y = local_vertices[i].y;
+            ++occupied_points;
+        }
+
+        if (print_timings)
+            section_profiler.print(use_bitplanes ? "mapToGraph loop map points (bitplane)" : "mapToGraph loop map points (bytes)");
+
+        //Set the minimum and maximum bounds for voronoi diagram. Follows planning window
+        jcv_rect rect;
+        rect.min.x = window.x;
+        rect.min.y = window.y;
+        rect.max.x = window.x + window.width - 1;
+        rect.max.y = window.y + window.height - 1;
+
+        jcv_diagram diagram;
+        memset(&diagram, 0, sizeof(jcv_diagram));
+
+        //Tried diagram generation in another thread, does not help. Memory comes from the arena, previous diagram was freed
+        generation_arena.reset();
+        jcv_diagram_generate_useralloc(occupied_points, site_buffer.data(), &rect, 0, &generation_arena,
+                                       GenerationArena::allocFn, GenerationArena::freeFn, &diagram);
+
+        //Get edges from voronoi diagram
+        std::vector<const jcv_edge *> edge_vector;
+        const jcv_edge *edges = jcv_diagram_get_edges(&diagram);
+        while (edges)
+        {
+            edge_vector.push_back(edges);
+            edges = jcv_diagram_get_next_edge(edges);
+        }
+
+        if (print_timings)
+            section_profiler.print("mapToGraph generating edges");
+
+        //Remove edge vertices that are in obtacle
+        removeObstacleVertices(edge_vector);
+
+        //Remove edges that pass through obstacle
+        removeCollisionEdges(edge_vector);
+
+        if (print_timings)
+            section_profiler.print("mapToGraph clearing edges");
+
+        //Convert edges to adjacency list
+        edgesToAdjacency(edge_vector);
+
+        if (print_timings)
+            section_profiler.print("mapToGraph convert edges to adjacency");
+
+        if (use_face_classes)
+        {
+            updateGraphFaces();
+
+            if (print_timings)
+                section_profiler.print("mapToGraph trace graph faces");
+        }
+
+        updateEdgeHomotopy();
+
+        if (print_timings)
+        {
+            section_profiler.print("mapToGraph precompute edge homotopy");
+            complete_profiler.print("mapToGraph total time");
+        }
+
+        jcv_diagram_free(&diagram);
+        graph_stale = false;
+        graph_updated = true;
+
+        if (coarse_levels > 0)
+        {
+            updateCoarseGraphs();
+
+            if (print_timings)
+                section_profiler.print("mapToGraph update coarse graphs");
+        }
+
+        //Coarse planning disabled after being used
+        else
+            coarse_graphs.clear();
+
+        return true;
+    }
+
+    bool voronoi_path::isGraphUpdated()
+    {
+        return graph_updated;
+    }
+
+    ThreadPool &voronoi_path::getThreadPool()
+    {
+        int pool_size = num_threads > 0 ? num_threads : std::max(1u, std::thread::hardware_concurrency());
+        if (!thread_pool || thread_pool->size() != pool_size)
+            thread_pool = std::make_shared<ThreadPool>(pool_size);
+
+        return *thread_pool;
+    }
+
+    std::vector<MapRect> voronoi_path::getChangedTiles()
+    {
+        std::lock_guard<std::mutex> lock(voronoi_mtx);
+        std::vector<MapRect> tiles;
+        tiles.reserve(changed_tiles.size());
+
+        int tile_size = 1 << TILE_SHIFT;
+        MapRect map_rect(0, 0, map_ptr->width, map_ptr->height);
+        for (const auto &tile : changed_tiles)
+            tiles.push_back(MapRect((tile % tile_cols) * tile_size, (tile / tile_cols) * tile_size, tile_size, tile_size).intersect(map_rect));
+
+        return tiles;
+    }
+
+    void voronoi_path::refreshMapCaches(const MapRect &window)
+    {
+        Profiler profiler;
+
+        //Refresh cached costs over regions that changed since the previous call, then consume those regions
+        //Changes outside of the window are dropped, a new window is refreshed entirely
+        std::vector<MapRect> &regions = dirty_regions;
+        regions.clear();
+        for (const auto &dirty : map_ptr->dirty_rects)
+        {
+            MapRect region = dirty.intersect(window);
+            if (!region.empty())
+                regions.push_back(region);
+        }
+
+        bool window_moved = window != planning_window;
+        if (window_moved || pyramid_map_width != map_ptr->width || pyramid_map_height != map_ptr->height)
+            updateCostPyramid(window);
+
+        else
+        {
+            for (const auto &region : regions)
+                updateCostPyramid(region);
+        }
+
+        if (print_timings)
+            profiler.print("mapToGraph update cost pyramid");
+
+        if (use_bitplanes)
+        {
+            if (window_moved || !bitplanesValid())
+                updateBitplanes(window);
+
+            else
+            {
+                for (const auto &region : regions)
+                    updateBitplanes(region);
+            }
+
+            if (print_timings)
+                profiler.print("mapToGraph update bitplanes");
+        }
+
+        //Planes are not kept up to date while disabled, force a rebuild if they are enabled again
+        else
+            bitplane_map_width = 0;
+
+        map_ptr->clearDirty();
+    }
+
+    bool voronoi_path::updateTileHashes(const MapRect &window)
+    {
+        int tile_size = 1 << TILE_SHIFT;
+        int cols = (map_ptr->width + tile_size - 1) >> TILE_SHIFT;
+        int rows = (map_ptr->height + tile_size - 1) >> TILE_SHIFT;
+        changed_tiles.clear();
+
+        std::vector<MapRect> &regions = dirty_regions;
+        regions.clear();
+        for (const auto &dirty : map_ptr->dirty_rects)
+            regions.push_back(dirty.intersect(window));
+
+        //Map was resized or window moved, hashes outside of the previous window are stale so every tile in window counts as changed
+        bool resized = cols != tile_cols || rows != tile_rows || window != planning_window;
+        if (resized)
+        {
+            if (cols != tile_cols || rows != tile_rows)
+                tile_hashes.assign(cols * rows, 0);
+
+            tile_cols = cols;
+            tile_rows = rows;
+            regions.assign(1, window);
+        }
+
+        //Dirty regions may overlap, hash each tile once
+        std::vector<bool> &hashed = hashed_tiles;
+        hashed.assign(tile_hashes.size(), false);
+        for (const auto &region : regions)
+        {
+            for (int tile_y = region.y >> TILE_SHIFT; tile_y < (region.y + region.height + tile_size - 1) >> TILE_SHIFT; ++tile_y)
+            {
+                for (int tile_x = region.x >> TILE_SHIFT; tile_x < (region.x + region.width + tile_size - 1) >> TILE_SHIFT; ++tile_x)
+                {
+                    int tile = tile_y * tile_cols + tile_x;
+                    if (hashed[tile])
+                        continue;
+
+                    hashed[tile] = true;
+                    uint64_t tile_hash = hashTile(tile_x, tile_y);
+                    if (resized || tile_hash != tile_hashes[tile])
+                    {
+                        tile_hashes[tile] = tile_hash;
+                        changed_tiles.push_back(tile);
+                    }
+                }
+            }
+        }
+
+        return !changed_tiles.empty();
+    }
+
+    uint64_t voronoi_path::hashTile(int tile_x, int tile_y)
+    {
+        int tile_size = 1 << TILE_SHIFT;
+        MapRect tile_rect = MapRect(tile_x * tile_size, tile_y * tile_size, tile_size, tile_size).intersect(MapRect(0, 0, map_ptr->width, map_ptr->height));
+
+        //FNV-1a, map cells are consumed 8 at a time
+        const uint64_t prime = 1099511628211ULL;
+        uint64_t tile_hash = 14695981039346656037ULL;
+        const signed char *map_data = map_ptr->cells();
+        for (int y = tile_rect.y; y < tile_rect.y + tile_rect.height; ++y)
+        {
+            const signed char *row = map_data + y * map_ptr->width + tile_rect.x;
+            int x = 0;
+            for (; x + 8 <= tile_rect.width; x += 8)
+            {
+                uint64_t word;
+                memcpy(&word, row + x, sizeof(word));
+                tile_hash = (tile_hash ^ word) * prime;
+                tile_hash ^= tile_hash >> 32;
+            }
+
+            for (; x < tile_rect.width; ++x)
+                tile_hash = (tile_hash ^ static_cast<unsigned char>(row[x])) * prime;
+        }
+
+        //Cells under the overlay are hashed again with their composited cost
+        MapRect overlay_rect = tile_rect.intersect(map_ptr->overlay.rect);
+        for (int y = overlay_rect.y; y < overlay_rect.y + overlay_rect.height; ++y)
+        {
+            for (int x = overlay_rect.x; x < overlay_rect.x + overlay_rect.width; ++x)
+                tile_hash = (tile_hash ^ static_cast<unsigned char>(map_ptr->getCost(x, y))) * prime;
+        }
+
+        return tile_hash;
+    }
+
+    bool voronoi_path::edgesToAdjacency(const std::vector<const jcv_edge *> &edge_vector)
+    {
+        //Reset all variables
+        adj_list.clear();
+        node_inf.clear();
+
+        std::unordered_map<uint64_t, int> hash_index_map;
+        for (int i = 0; i < edge_vector.size(); ++i)
+        {
+            //Get hash for both vertices of the current edge
+            uint64_t hash_vec[] = {hash(edge_vector[i]->pos[0].x, edge_vector[i]->pos[0].y),
+                                   hash(edge_vector[i]->pos[1].x, edge_vector[i]->pos[1].y)};
+            int node_index[] = {-1, -1};
+
+            //Check if each node is already in the map
+            for (int j = 0; j < 2; ++j)
+            {
+                auto node_it = hash_index_map.find(hash_vec[j]);
+
+                //Node already exists
+                if (node_it != hash_index_map.end())
+                    node_index[j] = node_it->second;
+
+                //Node doesn't exist, add new node to adjacency list & info vector, and respective hash and node index to map
+                else
+                {
+                    node_index[j] = adj_list.size();
+                    node_inf.emplace_back(edge_vector[i]->pos[j].x, edge_vector[i]->pos[j].y);
+                    adj_list.push_back(std::vector<int>());
+                    hash_index_map.insert(std::pair<uint64_t, int>(hash_vec[j], node_index[j]));
+                }
+            }
+
+            //Once both node indices are found, add edge between the two nodes if they aren't the same node
+            if (node_index[0] != node_index[1])
+            {
+                adj_list[node_index[0]].push_back(node_index[1]);
+                adj_list[node_index[1]].push_back(node_index[0]);
+            }
+        }
+
+        //Connect single edges to nearby node if <= node_connection_threshold_pix pixel distance
+        std::vector<int> unconnected_nodes;
+        int threshold = pow(node_connection_threshold_pix, 2);
+        for (int node_num = 0; node_num < adj_list.size(); ++node_num)
+        {
+            //Singly connected node
+            if (adj_list[node_num].size() == 1)
+            {
+                //Check through all node_inf to see if there are any within distance threshold
+                for (int j = 0; j < node_inf.size(); ++j)
+                {
+                    //If the node being checked is itself or is already connected to the checked node, new_adj_list[i] only has 1 element
+                    if (j == node_num || adj_list[node_num].back() == j)
+                        continue;
+
+                    double dist = pow(node_inf[j].x - node_inf[node_num].x, 2) + pow(node_inf[j].y - node_inf[node_num].y, 2);
+                    if (dist <= threshold)
+                    {
+                        adj_list[node_num].push_back(j);
+                        adj_list[j].push_back(node_num);
+                        break;
+                    }
+
+                    //Remember nodes that were unconnected to trim later
+                    if(j == node_inf.size() - 1)
+                        unconnected_nodes.push_back(node_num);
+                }
+            }
+        }
+
+        //Loop through all nodes that were unable to be connected for trimming
+        auto new_adj_list = adj_list;
+        double thresh = sqrt(lonely_branch_dist_threshold) / map_ptr->resolution;
+        for(const auto &node_num : unconnected_nodes)
+            removeExcessBranch(new_adj_list, thresh, node_num);
+
+        adj_list = std::move(new_adj_list);
+        num_nodes = adj_list.size();
+        return true;
+    }
+
+    std::vector<std::vector<int>> voronoi_path::getAdjList()
+    {
+        std::lock_guard<std::mutex> lock(voronoi_mtx);
+        return adj_list;
+    }
+
+    std::vector<GraphNode> voronoi_path::getNodeInfo()
+    {
+        std::lock_guard<std::mutex> lock(voronoi_mtx);
+        return node_inf;
+    }
+
+    std::vector<std::pair<double, int>> voronoi_path::getSortedNodeList(GraphNode position)
+    {
+        sorted_node_list.clear();
+        double min_start_dist = std::numeric_limits<double>::infinity();
+
+        //Store list of distances to each node from current position
+        for (int i = 0; i < num_nodes; ++i)
+            sorted_node_list.emplace_back(pow(node_inf[i].x - position.x, 2) + pow(node_inf[i].y - position.y, 2), i);
+
+        //Sort list of nodes and distance
+        sort(sorted_node_list.begin(), sorted_node_list.end(), [](std::pair<double, int> &left, std::pair<double, int> &right) {
+            return left.first < right.first;
+        });
+        return sorted_node_list;
+    }
+
+    bool voronoi_path::getObstacleCentroids(std::vector<GraphNode> &centroids)
+    {
+        //Obstacles outside of the homotopy corridor are included
+        centroids.reserve(obstacles.size());
+        for (const auto &obstacle : obstacles)
+        {
+            if (obstacle.significant)
+                centroids.emplace_back(obstacle.point.real(), obstacle.point.imag());
+        }
+
+        return true;
+    }
+
+    std::vector<double> voronoi_path::getAllPathCosts()
+    {
+        return previous_path_costs;
+    }
+
+    bool voronoi_path::getEdges(std::vector<GraphNode> &edges)
+    {
+        std::lock_guard<std::mutex> lock(voronoi_mtx);
+
+        // Total number is unknown, reserve minimum amount needed
+        edges.reserve(num_nodes);
         for (int i = 0; i < num_nodes; ++i)
         {
             for (int j = 0; j < adj_list[i].size(); ++j)
@@ -421,9 +1418,9 @@ namespace voronoi_path
         std::cout << std::endl;
     }
 
-    uint32_t voronoi_path::hash(const double &x, const double &y)
+    uint64_t voronoi_path::hash(const double &x, const double &y)
     {
-        uint32_t hashed_int = static_cast<uint32_t>((static_cast<uint16_t>(x) << 16) ^ static_cast<uint16_t>(y));
+        uint64_t hashed_int = (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(y);
         return hashed_int;
     }
 
@@ -549,103 +1546,401 @@ namespace voronoi_path
                 // If currently modified node has no collision with collision node, then it is the future anchor, break once set
                 if (!edgeCollides(path[j], path[collision_node], trimming_collision_threshold))
                 {
-                    future_anchor_node = j;
-                    break;
+                    future_anchor_node = j;
+                    break;
+                }
+            }
+
+            prev_collision_node = collision_node;
+            anchor_node = future_anchor_node;
+        }
+
+        return true;
+    }
+
+    std::vector<Path> voronoi_path::getPath(const GraphNode &start, const GraphNode &end, const int &num_paths)
+    {
+        //Block until voronoi is no longer being updated. Prevents issue where planning is done using an empty adjacency list
+        std::lock_guard<std::mutex> lock(voronoi_mtx);
+        setHomotopyCorridor(start, end);
+
+        Profiler complete_profiler, section_profiler;
+        std::vector<Path> path;
+
+        //Search coarse graphs first, full resolution search is only needed if no coarse route could be refined
+        if (coarse_levels > 0 && !coarse_graphs.empty())
+        {
+            std::vector<std::vector<int>> all_paths;
+            if (findCoarseToFinePaths(start, end, num_paths, all_paths))
+            {
+                if (print_timings)
+                    section_profiler.print("getPath find coarse to fine paths");
+
+                path = buildPaths(start, end, all_paths);
+
+                if (print_timings)
+                    complete_profiler.print("getPath find all paths");
+
+                return path;
+            }
+
+            std::cout << "No coarse route could be refined, searching full resolution graph" << std::endl;
+        }
+
+        //Find nearest node to starting and end positions
+        int start_node, end_node;
+        if (!getNearestNode(start, end, start_node, end_node))
+            return std::vector<Path>();
+
+        if (print_timings)
+            section_profiler.print("getPath find nearest node");
+
+        //Paths of distinct classes in one search, shortest first
+        if (use_homotopy_search)
+        {
+            std::vector<std::vector<int>> all_paths;
+            if (num_paths >= 1)
+                findHomotopyPaths(start_node, end_node, all_paths, num_paths);
+
+            if (print_timings)
+                section_profiler.print("getPath find homotopy paths");
+
+            if (!all_paths.empty())
+            {
+                path = buildPaths(start, end, all_paths);
+
+                if (print_timings)
+                    complete_profiler.print("getPath find all paths");
+            }
+
+            else
+                std::cout << "Path could not be found" << std::endl;
+
+            return path;
+        }
+
+        std::vector<int> shortest_path;
+        if (findShortestPath(start_node, end_node, shortest_path))
+        {
+            if (print_timings)
+                section_profiler.print("getPath find shortest path");
+
+            std::vector<std::vector<int>> all_paths;
+            //Get next shortest path
+            if (num_paths >= 1)
+                kthShortestPaths(start_node, end_node, shortest_path, all_paths, num_paths - 1);
+
+            if (print_timings)
+                section_profiler.print("getPath find kth shortest paths");
+
+            path = buildPaths(start, end, all_paths);
+
+            if (print_timings)
+                complete_profiler.print("getPath find all paths");
+        }
+
+        else
+            std::cout << "Path could not be found" << std::endl;
+
+        return path;
+    }
+
+    std::vector<std::vector<GraphNode>> voronoi_path::getGraphPaths(const GraphNode &start, const GraphNode &end, int num_paths, std::vector<double> &costs)
+    {
+        std::lock_guard<std::mutex> lock(voronoi_mtx);
+        setHomotopyCorridor(start, end);
+
+        std::vector<std::vector<int>> all_paths;
+        std::vector<int> shortest_path;
+        int start_node, end_node;
+        if (num_paths >= 1 && getNearestNode(start, end, start_node, end_node))
+        {
+            if (use_homotopy_search)
+                findHomotopyPaths(start_node, end_node, all_paths, num_paths);
+
+            else if (findShortestPath(start_node, end_node, shortest_path))
+                kthShortestPaths(start_node, end_node, shortest_path, all_paths, num_paths - 1);
+        }
+
+        std::vector<std::vector<GraphNode>> paths;
+        costs.assign(all_paths.size(), 0);
+        for (int j = 0; j < all_paths.size(); ++j)
+        {
+            paths.push_back(convertToPixelPath(all_paths[j]));
+            for (int i = 1; i < all_paths[j].size(); ++i)
+                costs[j] += euclideanDist(node_inf[all_paths[j][i - 1]], node_inf[all_paths[j][i]]);
+        }
+
+        return paths;
+    }
+
+    std::vector<Path> voronoi_path::buildPaths(const GraphNode &start, const GraphNode &end, const std::vector<std::vector<int>> &all_paths)
+    {
+        Profiler section_profiler;
+
+        //Copy all_paths into new container which include start and end
+        std::vector<Path> all_path_nodes;
+        all_path_nodes.reserve(all_paths.size());
+        for (int i = 0; i < all_paths.size(); ++i)
+        {
+            all_path_nodes.emplace_back(getUniqueID(), std::vector<GraphNode>{start});
+            all_path_nodes[i].path.reserve(all_paths[i].size() + 2);
+
+            for (const auto &node : all_paths[i])
+                all_path_nodes[i].path.emplace_back(node_inf[node].x, node_inf[node].y);
+
+            all_path_nodes[i].path.push_back(end);
+        }
+
+        if (print_timings)
+            section_profiler.print("getPath insert start and end");
+
+        //Trim beginning of path to remove unnecessary u-turns in path
+        interpolateContractPaths(all_path_nodes);
+
+        if (print_timings)
+            section_profiler.print("getPath interpolate and contract");
+
+        //Only set previous paths and their costs if this was the first getPath call
+        if (!hasPreviousPaths())
+        {
+            previous_paths = all_path_nodes;
+            previous_path_costs = std::vector<double>(all_path_nodes.size(), 0);
+
+            for (int j = 0; j < all_path_nodes.size(); ++j)
+            {
+                for (int i = 0; i < all_path_nodes[j].path.size() - 1; ++i)
+                    previous_path_costs[j] += euclideanDist(all_path_nodes[j].path[i], all_path_nodes[j].path[i + 1]);
+            }
+
+            //Swap minimum cost path with first in list, sometimes after contraction the first index path is no longer the shortest
+            auto min_it = std::min_element(previous_path_costs.begin(), previous_path_costs.end());
+            int ind = std::distance(previous_path_costs.begin(), min_it);
+            std::swap(previous_path_costs[0], previous_path_costs[ind]);
+            std::swap(all_path_nodes[0], all_path_nodes[ind]);
+
+            if (print_timings)
+                section_profiler.print("getPath get all initial costs");
+        }
+
+        return all_path_nodes;
+    }
+
+    void voronoi_path::updateCoarseGraphs()
+    {
+        if (coarse_graphs.size() != coarse_levels)
+        {
+            coarse_graphs.clear();
+            coarse_graphs.resize(std::max(coarse_levels, 0));
+            for (int level = 0; level < coarse_graphs.size(); ++level)
+            {
+                coarse_graphs[level].graph.reset(new voronoi_path());
+                coarse_graphs[level].graph->is_coarse_level = true;
+                coarse_graphs[level].scale = 1 << (2 * (level + 1));
+            }
+        }
+
+        for (int level = 0; level < coarse_graphs.size(); ++level)
+        {
+            CoarseLevel &coarse = coarse_graphs[level];
+
+            //Each level pools 4x4 cells of the level below, the first level pools the composited planning window
+            const Map *below = level == 0 ? map_ptr : &coarse_graphs[level - 1].map;
+            MapRect below_rect = level == 0 ? planning_window : MapRect(0, 0, below->width, below->height);
+            int width = (below_rect.width + 3) / 4;
+            int height = (below_rect.height + 3) / 4;
+            std::vector<signed char> pooled(width * height, std::numeric_limits<signed char>::min());
+            for (int y = 0; y < below_rect.height; ++y)
+            {
+                signed char *pooled_row = &pooled[(y / 4) * width];
+                for (int x = 0; x < below_rect.width; ++x)
+                {
+                    signed char cost = below->getCost(below_rect.x + x, below_rect.y + y);
+                    if (cost > pooled_row[x / 4])
+                        pooled_row[x / 4] = cost;
                 }
             }
 
-            prev_collision_node = collision_node;
-            anchor_node = future_anchor_node;
+            coarse.map.setData(std::move(pooled));
+            coarse.map.width = width;
+            coarse.map.height = height;
+            coarse.map.resolution = map_ptr->resolution * coarse.scale;
+            coarse.map.frame_id = map_ptr->frame_id;
+            coarse.map.origin = map_ptr->origin;
+            coarse.map.origin.position.x += planning_window.x * map_ptr->resolution;
+            coarse.map.origin.position.y += planning_window.y * map_ptr->resolution;
+            coarse.map.clearDirty();
+            coarse.map.markDirty(MapRect(0, 0, width, height));
+
+            //Coarse graphs are built and checked with the same thresholds as this one
+            voronoi_path &graph = *coarse.graph;
+            graph.print_timings = false;
+            graph.num_threads = num_threads;
+            graph.thread_pool = thread_pool;
+            graph.occupancy_threshold = occupancy_threshold;
+            graph.collision_threshold = collision_threshold;
+            graph.trimming_collision_threshold = trimming_collision_threshold;
+            graph.line_check_resolution = line_check_resolution;
+            graph.use_bitplanes = use_bitplanes;
+            graph.boundary_sites = boundary_sites;
+            graph.site_tolerance = site_tolerance;
+            graph.min_obstacle_area = min_obstacle_area;
+            graph.filter_obstacle_sites = filter_obstacle_sites;
+            graph.h_class_threshold = h_class_threshold;
+            graph.use_winding_numbers = use_winding_numbers;
+            graph.use_face_classes = use_face_classes;
+            graph.use_homotopy_search = use_homotopy_search;
+            graph.homotopy_corridor_ratio = homotopy_corridor_ratio;
+            graph.node_connection_threshold_pix = node_connection_threshold_pix;
+            graph.lonely_branch_dist_threshold = lonely_branch_dist_threshold;
+            graph.path_waypoint_sep = path_waypoint_sep;
+            graph.search_radius = search_radius;
+            graph.mapToGraph(&coarse.map);
         }
-
-        return true;
     }
 
-    std::vector<Path> voronoi_path::getPath(const GraphNode &start, const GraphNode &end, const int &num_paths)
+    bool voronoi_path::findCoarseToFinePaths(const GraphNode &start, const GraphNode &end, int num_paths, std::vector<std::vector<int>> &all_paths)
     {
-        //Block until voronoi is no longer being updated. Prevents issue where planning is done using an empty adjacency list
-        std::lock_guard<std::mutex> lock(voronoi_mtx);
-
-        Profiler complete_profiler, section_profiler;
-        std::vector<Path> path;
+        //Conversion between pixels of this graph and pixels of a coarse level, coarse pixels are relative to the planning window
+        auto to_level = [&](const GraphNode &point, int scale) {
+            return scale == 1 ? point : GraphNode((point.x - planning_window.x) / scale, (point.y - planning_window.y) / scale);
+        };
+        auto from_level = [&](const GraphNode &point, int scale) {
+            return scale == 1 ? point : GraphNode(planning_window.x + point.x * scale, planning_window.y + point.y * scale);
+        };
+
+        //Routes follow edges of the coarsest graph, contracted paths may cut through open space far from any finer edge
+        CoarseLevel &coarsest = coarse_graphs.back();
+        std::vector<std::vector<GraphNode>> routes;
+        {
+            voronoi_path &graph = *coarsest.graph;
+            std::lock_guard<std::mutex> coarse_lock(graph.voronoi_mtx);
+
+            int start_node, end_node;
+            std::vector<int> shortest_path;
+            std::vector<std::vector<int>> coarse_paths;
+            graph.setHomotopyCorridor(to_level(start, coarsest.scale), to_level(end, coarsest.scale));
+            if (!graph.getNearestNode(to_level(start, coarsest.scale), to_level(end, coarsest.scale), start_node, end_node))
+                return false;
 
-        //Find nearest node to starting and end positions
-        int start_node, end_node;
-        if (!getNearestNode(start, end, start_node, end_node))
-            return std::vector<Path>();
+            if (graph.use_homotopy_search)
+            {
+                if (!graph.findHomotopyPaths(start_node, end_node, coarse_paths, std::max(num_paths, 1)) && coarse_paths.empty())
+                    return false;
+            }
 
-        if (print_timings)
-            section_profiler.print("getPath find nearest node");
+            else
+            {
+                if (!graph.findShortestPath(start_node, end_node, shortest_path))
+                    return false;
 
-        std::vector<int> shortest_path;
-        if (findShortestPath(start_node, end_node, shortest_path))
-        {
-            if (print_timings)
-                section_profiler.print("getPath find shortest path");
+                graph.kthShortestPaths(start_node, end_node, shortest_path, coarse_paths, std::max(num_paths - 1, 0));
+            }
 
-            std::vector<std::vector<int>> all_paths;
-            //Get next shortest path
-            if (num_paths >= 1)
-                kthShortestPaths(start_node, end_node, shortest_path, all_paths, num_paths - 1);
+            for (const auto &coarse_path : coarse_paths)
+                routes.push_back(graph.convertToPixelPath(coarse_path));
+        }
 
-            if (print_timings)
-                section_profiler.print("getPath find kth shortest paths");
+        HomotopyRegistry registry(use_winding_numbers || use_face_classes, h_class_threshold);
+        for (auto &route : routes)
+        {
+            int route_scale = coarsest.scale;
+            std::vector<int> node_path;
+            bool refined = true;
 
-            //Copy all_paths into new container which include start and end
-            std::vector<Path> all_path_nodes;
-            all_path_nodes.reserve(all_paths.size());
-            for (int i = 0; i < all_paths.size(); ++i)
+            //Refine through every finer level, level -1 is this graph
+            for (int level = coarse_graphs.size() - 2; level >= -1 && refined; --level)
             {
-                all_path_nodes.emplace_back(getUniqueID(), std::vector<GraphNode>{start});
-                all_path_nodes[i].path.reserve(all_paths[i].size() + 2);
+                voronoi_path &graph = level >= 0 ? *coarse_graphs[level].graph : *this;
+                int scale = level >= 0 ? coarse_graphs[level].scale : 1;
+
+                std::vector<GraphNode> level_route;
+                level_route.reserve(route.size());
+                for (const auto &point : route)
+                    level_route.push_back(to_level(from_level(point, route_scale), scale));
+
+                //This graph is already locked by getPath
+                std::unique_lock<std::mutex> level_lock;
+                if (level >= 0)
+                    level_lock = std::unique_lock<std::mutex>(graph.voronoi_mtx);
+
+                node_path.clear();
+                double radius = corridor_radius / (map_ptr->resolution * scale) + route_scale / scale;
+                refined = graph.findCorridorPath(to_level(start, scale), to_level(end, scale), level_route, radius, node_path);
+                route = graph.convertToPixelPath(node_path);
+                route_scale = scale;
+            }
 
-                for (const auto &node : all_paths[i])
-                    all_path_nodes[i].path.emplace_back(node_inf[node].x, node_inf[node].y);
+            if (!refined)
+                continue;
 
-                all_path_nodes[i].path.push_back(end);
-            }
+            //Routes of different coarse classes may merge once refined
+            if (registry.insert(nodePathClass(node_path), all_paths.size(), 0))
+                all_paths.push_back(std::move(node_path));
+        }
 
-            if (print_timings)
-                section_profiler.print("getPath insert start and end");
+        return !all_paths.empty();
+    }
+
+    bool voronoi_path::findCorridorPath(const GraphNode &start, const GraphNode &end, const std::vector<GraphNode> &route, double radius, std::vector<int> &path)
+    {
+        int start_node, end_node;
+        if (route.empty() || !getNearestNode(start, end, start_node, end_node))
+            return false;
 
-            //Trim beginning of path to remove unnecessary u-turns in path
-            interpolateContractPaths(all_path_nodes);
+        //Rasterize route into a grid with cells the size of radius, nodes in the cells around route cells are allowed
+        double cell = std::max(1.0, radius);
+        double min_x = std::min(start.x, end.x), max_x = std::max(start.x, end.x);
+        double min_y = std::min(start.y, end.y), max_y = std::max(start.y, end.y);
+        for (const auto &point : route)
+        {
+            min_x = std::min(min_x, point.x);
+            max_x = std::max(max_x, point.x);
+            min_y = std::min(min_y, point.y);
+            max_y = std::max(max_y, point.y);
+        }
 
-            if (print_timings)
-                section_profiler.print("getPath interpolate and contract");
+        min_x -= cell;
+        min_y -= cell;
+        int grid_width = static_cast<int>((max_x + cell - min_x) / cell) + 1;
+        int grid_height = static_cast<int>((max_y + cell - min_y) / cell) + 1;
+        std::vector<bool> route_cells(grid_width * grid_height, false);
+        auto mark = [&](const GraphNode &point) {
+            route_cells[static_cast<int>((point.y - min_y) / cell) * grid_width + static_cast<int>((point.x - min_x) / cell)] = true;
+        };
+
+        //Route is joined to start and end
+        std::vector<GraphNode> line{start};
+        line.insert(line.end(), route.begin(), route.end());
+        line.push_back(end);
+        for (int i = 1; i < line.size(); ++i)
+        {
+            int samples = static_cast<int>(euclideanDist(line[i - 1], line[i]) * 2 / cell) + 1;
+            for (int j = 0; j <= samples; ++j)
+                mark(line[i - 1] + (line[i] - line[i - 1]) * (j / static_cast<double>(samples)));
+        }
 
-            //Only set previous paths and their costs if this was the first getPath call
-            if (!hasPreviousPaths())
+        std::vector<bool> node_mask(num_nodes, false);
+        for (int i = 0; i < num_nodes; ++i)
+        {
+            int cell_x = floor((node_inf[i].x - min_x) / cell);
+            int cell_y = floor((node_inf[i].y - min_y) / cell);
+            for (int y = std::max(0, cell_y - 1); y <= std::min(grid_height - 1, cell_y + 1) && !node_mask[i]; ++y)
             {
-                previous_paths = all_path_nodes;
-                previous_path_costs = std::vector<double>(all_path_nodes.size(), 0);
-
-                for (int j = 0; j < all_path_nodes.size(); ++j)
+                for (int x = std::max(0, cell_x - 1); x <= std::min(grid_width - 1, cell_x + 1); ++x)
                 {
-                    for (int i = 0; i < all_path_nodes[j].path.size() - 1; ++i)
-                        previous_path_costs[j] += euclideanDist(all_path_nodes[j].path[i], all_path_nodes[j].path[i + 1]);
+                    if (route_cells[y * grid_width + x])
+                    {
+                        node_mask[i] = true;
+                        break;
+                    }
                 }
-
-                //Swap minimum cost path with first in list, sometimes after contraction the first index path is no longer the shortest
-                auto min_it = std::min_element(previous_path_costs.begin(), previous_path_costs.end());
-                int ind = std::distance(previous_path_costs.begin(), min_it);
-                std::swap(previous_path_costs[0], previous_path_costs[ind]);
-                std::swap(all_path_nodes[0], all_path_nodes[ind]);
-
-                if (print_timings)
-                    section_profiler.print("getPath get all initial costs");
             }
-
-            path = std::move(all_path_nodes);
-
-            if (print_timings)
-                complete_profiler.print("getPath find all paths");
         }
 
-        else
-            std::cout << "Path could not be found" << std::endl;
-
-        return path;
+        node_mask[start_node] = true;
+        node_mask[end_node] = true;
+        return findShortestPath(start_node, end_node, path, &node_mask);
     }
 
     std::vector<Path> voronoi_path::replan(GraphNode &start, GraphNode &end, int num_paths, int &pref_path)
@@ -706,23 +2001,40 @@ namespace voronoi_path
 
         //Calculate homotopy class of previous set of paths
         Profiler homotopy_profiler;
-        std::vector<std::complex<double>> previous_classes;
-        for (const auto &path : replanned_paths)
-            previous_classes.push_back(calcHomotopyClass(path.path));
+        //Only the start of a retained path moved, contraction straightens it through free space without changing its class.
+        //Classes of previous paths are read after getPath, which updates them if obstacles of the homotopy corridor changed
+        std::vector<int> narrow_centers;
+        double waypoint_sep = path_waypoint_sep / map_ptr->resolution;
+        for (int j = 0; j < center_sizes.size(); ++j)
+        {
+            if (center_sizes[j] <= waypoint_sep)
+                narrow_centers.push_back(j);
+        }
+
+        HomotopyRegistry registry(use_winding_numbers, h_class_threshold);
+        for (int i = 0; i < replanned_paths.size(); ++i)
+        {
+            Path &path = replanned_paths[i];
+            const Path &previous = previous_paths[i];
+            if (previous.has_h_class && !previous.path.empty() && !path.path.empty() && previous.path.back() == path.path.back())
+                path.h_class = replannedPathClass(previous, path.path, narrow_centers);
+
+            else
+                path.h_class = calcHomotopyClass(path.path);
+
+            path.has_h_class = true;
+            registry.insert(path.h_class, i, 0);
+        }
 
         if (print_timings)
             homotopy_profiler.print("replan homotopy calc");
 
         // Add potential paths that are unique to replanned_paths container
-        for (const auto &path : potential_paths)
+        for (auto &path : potential_paths)
         {
-            std::complex<double> temp_class = calcHomotopyClass(path.path);
-            bool unique = true;
-            for (const auto &prev_class : previous_classes)
-                if (!isClassDifferent(temp_class, prev_class))
-                    unique = false;
-
-            if (unique)
+            path.h_class = calcHomotopyClass(path.path);
+            path.has_h_class = true;
+            if (registry.insert(path.h_class, replanned_paths.size(), 0))
                 replanned_paths.push_back(path);
         }
 
@@ -747,163 +2059,630 @@ namespace voronoi_path
         //If number of paths greater than num_paths, delete longest paths until equal
         while (replanned_paths.size() > num_paths)
         {
-            auto max_it = std::max_element(all_paths_cost.begin(), all_paths_cost.end());
-            int ind = std::distance(all_paths_cost.begin(), max_it);
+            auto max_it = std::max_element(all_paths_cost.begin(), all_paths_cost.end());
+            int ind = std::distance(all_paths_cost.begin(), max_it);
+
+            //Order of paths < num_paths must be maintained
+            //If max element is greater than or equal to num_paths limit, means it is a potential path, just delete
+            if (ind >= num_paths)
+            {
+                all_paths_cost.erase(max_it);
+                replanned_paths.erase(replanned_paths.begin() + ind);
+            }
+
+            //Path is < num_paths, swap with one of the paths behind and then delete last
+            else
+            {
+                std::swap(replanned_paths[ind], replanned_paths[replanned_paths.size() - 1]);
+                std::swap(all_paths_cost[ind], all_paths_cost[all_paths_cost.size() - 1]);
+
+                replanned_paths.pop_back();
+                all_paths_cost.pop_back();
+            }
+        }
+
+        //Restore pref path cost
+        all_paths_cost[pref_path] = pref_path_cost;
+
+        //Update previous paths and their costs for the next round of replanning
+        previous_paths = replanned_paths;
+        previous_path_costs = all_paths_cost;
+
+        if (print_timings)
+            complete_profiler.print("replan total replan time");
+
+        return replanned_paths;
+    }
+
+    bool voronoi_path::getNearestNode(const GraphNode &start, const GraphNode &end, int &start_node, int &end_node)
+    {
+        //TODO: Should not only check nearest nodes. Should allow nearest position to be on an edge
+        double min_start_dist = std::numeric_limits<double>::infinity();
+        double min_end_dist = std::numeric_limits<double>::infinity();
+        start_node = -1;
+        end_node = -1;
+
+        //Traverse all nodes to find the one with minimum distance from start and end points
+        for (int i = 0; i < num_nodes; ++i)
+        {
+            if (adj_list[i].empty())
+                continue;
+
+            GraphNode curr = node_inf[i];
+            double temp_start_dist = pow(curr.x - start.x, 2) + pow(curr.y - start.y, 2);
+            if (temp_start_dist < min_start_dist)
+            {
+                if (is_coarse_level || !edgeCollides(start, curr, collision_threshold))
+                {
+                    min_start_dist = temp_start_dist;
+                    start_node = i;
+                }
+            }
+
+            double temp_end_dist = pow(curr.x - end.x, 2) + pow(curr.y - end.y, 2);
+            if (temp_end_dist < min_end_dist)
+            {
+                if (is_coarse_level || !edgeCollides(end, curr, collision_threshold))
+                {
+                    min_end_dist = temp_end_dist;
+                    end_node = i;
+                }
+            }
+        }
+
+        //Failed to find start/end even after relaxation
+        if (start_node == -1 || end_node == -1)
+        {
+            std::cout << "Failed to find nearest starting or ending node" << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    std::vector<GraphNode> voronoi_path::convertToPixelPath(const std::vector<int> &path_)
+    {
+        std::vector<GraphNode> return_path;
+        return_path.reserve(path_.size());
+        for (const auto &node : path_)
+            return_path.emplace_back(node_inf[node].x, node_inf[node].y);
+
+        return return_path;
+    }
+
+    //https://www.cs.huji.ac.il/~jeff/aaai10/02/AAAI10-216.pdf
+    HomotopyClass voronoi_path::calcHomotopyClass(const std::vector<GraphNode> &path_)
+    {
+        HomotopyClass h_class;
+        int num_obstacles = centers.size();
+        if (path_.size() < 2 || num_obstacles == 0)
+            return h_class;
+
+        //Count crossings of every obstacle's branch cut, buffers are kept per thread so repeated calls do not allocate
+        static thread_local std::vector<double> crossings;
+        static thread_local std::vector<double> windings;
+        crossings.resize(std::max<size_t>(crossings.size(), num_obstacles));
+        windings.resize(std::max<size_t>(windings.size(), num_obstacles));
+        pathCrossings(path_, center_x.data(), center_y.data(), num_obstacles, crossings.data());
+
+        //Closing the path from end back to start leaves whole turns only
+        const GraphNode &start = path_.front();
+        const GraphNode &end = path_.back();
+        std::copy(crossings.begin(), crossings.begin() + num_obstacles, windings.begin());
+        segmentCrossings(end, start, center_x.data(), center_y.data(), num_obstacles, windings.data());
+
+        //Only the end points need log and arg, the crossings give the whole turns in between
+        for (int j = 0; j < num_obstacles; ++j)
+        {
+            h_class.h_signature += pathHomotopy(start, end, centers[j], crossings[j]) * obs_coeff[j];
+            if (windings[j] != 0)
+                h_class.windings.emplace_back(center_ids[j], static_cast<int>(windings[j]));
+        }
+
+        std::sort(h_class.windings.begin(), h_class.windings.end());
+        return h_class;
+    }
+
+    HomotopyClass voronoi_path::replannedPathClass(const Path &previous, const std::vector<GraphNode> &path, const std::vector<int> &narrow_centers)
+    {
+        HomotopyClass h_class = previous.h_class;
+        int num_obstacles = centers.size();
+        if (num_obstacles == 0)
+            return h_class;
+
+        const GraphNode &start = previous.path.front();
+        const GraphNode &new_start = path.front();
+        const GraphNode &end = path.back();
+
+        //The path now begins with an edge from new_start to the previous start
+        static thread_local std::vector<double> crossings;
+        crossings.assign(num_obstacles, 0);
+        segmentCrossings(new_start, start, center_x.data(), center_y.data(), num_obstacles, crossings.data());
+
+        //Narrow obstacles can fall between the collision checks of contraction, count their crossings on both paths
+        if (!narrow_centers.empty())
+        {
+            int num_narrow = narrow_centers.size();
+            std::vector<double> narrow_x(num_narrow), narrow_y(num_narrow);
+            for (int k = 0; k < num_narrow; ++k)
+            {
+                narrow_x[k] = center_x[narrow_centers[k]];
+                narrow_y[k] = center_y[narrow_centers[k]];
+            }
+
+            std::vector<double> previous_crossings(num_narrow), path_crossings(num_narrow);
+            pathCrossings(previous.path, narrow_x.data(), narrow_y.data(), num_narrow, previous_crossings.data());
+            segmentCrossings(new_start, start, narrow_x.data(), narrow_y.data(), num_narrow, previous_crossings.data());
+            pathCrossings(path, narrow_x.data(), narrow_y.data(), num_narrow, path_crossings.data());
+            for (int k = 0; k < num_narrow; ++k)
+                crossings[narrow_centers[k]] += path_crossings[k] - previous_crossings[k];
+        }
+
+        for (int j = 0; j < num_obstacles; ++j)
+            h_class.h_signature += pathHomotopy(new_start, start, centers[j], crossings[j]) * obs_coeff[j];
+
+        //The closing edge now goes from end to new_start instead of start, windings also change by the triangle between them
+        segmentCrossings(start, end, center_x.data(), center_y.data(), num_obstacles, crossings.data());
+        segmentCrossings(end, new_start, center_x.data(), center_y.data(), num_obstacles, crossings.data());
+        std::map<uint32_t, int> windings(h_class.windings.begin(), h_class.windings.end());
+        for (int j = 0; j < num_obstacles; ++j)
+        {
+            if (crossings[j] != 0)
+                windings[center_ids[j]] += static_cast<int>(crossings[j]);
+        }
+
+        h_class.windings.clear();
+        for (const auto &winding : windings)
+        {
+            if (winding.second != 0)
+                h_class.windings.push_back(winding);
+        }
+
+        return h_class;
+    }
+
+    int voronoi_path::windingNumber(const std::vector<GraphNode> &path, const std::complex<double> &center)
+    {
+        if (path.size() < 2)
+            return 0;
+
+        //Crossings of the path closed from end back to start
+        double center_x = center.real();
+        double center_y = center.imag();
+        double crossings;
+        pathCrossings(path, &center_x, &center_y, 1, &crossings);
+        segmentCrossings(path.back(), path.front(), &center_x, &center_y, 1, &crossings);
+        return static_cast<int>(crossings);
+    }
+
+    HomotopyClass voronoi_path::nodePathClass(const std::vector<int> &path)
+    {
+        return nodePathClass(path, sumEdgeTerms(path, 0, path.size() - 1));
+    }
+
+    HomotopyClass voronoi_path::nodePathClass(const std::vector<int> &path, const std::complex<double> &edge_terms)
+    {
+        HomotopyClass h_class;
+        int num_obstacles = centers.size();
+        if (path.size() < 2 || num_obstacles == 0)
+            return h_class;
+
+        //Log terms of the end points, computed once per node since Yen's candidates share their start and end
+        auto potential = [&](int node) {
+            auto potential_it = node_potentials.find(node);
+            if (potential_it != node_potentials.end())
+                return potential_it->second;
+
+            std::complex<double> sum;
+            std::complex<double> point(node_inf[node].x, node_inf[node].y);
+            for (int j = 0; j < num_obstacles; ++j)
+                sum += std::log(point - centers[j]) * obs_coeff[j];
+
+            node_potentials.emplace(node, sum);
+            return sum;
+        };
+
+        //Paths between the same end points only differ in the face cuts they cross, end point terms are not needed
+        h_class.h_signature = use_face_classes ? edge_terms : potential(path.back()) - potential(path.front()) + edge_terms;
+        static thread_local std::vector<double> windings;
+        windings.assign(num_obstacles, 0);
+        for (int i = 1; i < path.size(); ++i)
+        {
+            const EdgeHomotopy *edge = findEdgeHomotopy(path[i - 1], path[i]);
+            if (edge)
+            {
+                for (int k = edge->crossings_begin; k < edge->crossings_end; ++k)
+                    windings[edge_crossings[k].first] += edge->direction * edge_crossings[k].second;
+            }
+
+            else if (!use_face_classes)
+                segmentCrossings(node_inf[path[i - 1]], node_inf[path[i]], center_x.data(), center_y.data(), num_obstacles, windings.data());
+        }
+
+        if (!use_face_classes)
+            segmentCrossings(node_inf[path.back()], node_inf[path.front()], center_x.data(), center_y.data(), num_obstacles, windings.data());
+
+        for (int j = 0; j < num_obstacles; ++j)
+        {
+            if (windings[j] != 0)
+                h_class.windings.emplace_back(center_ids[j], static_cast<int>(windings[j]));
+        }
+
+        std::sort(h_class.windings.begin(), h_class.windings.end());
+        return h_class;
+    }
+
+    std::complex<double> voronoi_path::sumEdgeTerms(const std::vector<int> &path, int first, int last)
+    {
+        std::complex<double> sum;
+        for (int i = first + 1; i <= last; ++i)
+        {
+            const EdgeHomotopy *edge = findEdgeHomotopy(path[i - 1], path[i]);
+            if (edge)
+                sum += edge->term;
+
+            else if (!use_face_classes)
+                sum += edgeTerm(node_inf[path[i - 1]], node_inf[path[i]], nullptr);
+        }
+
+        return sum;
+    }
+
+    const voronoi_path::EdgeHomotopy *voronoi_path::findEdgeHomotopy(int node, int next_node)
+    {
+        if (node >= edge_homotopy.size())
+            return nullptr;
+
+        for (const auto &edge : edge_homotopy[node])
+        {
+            if (edge.node == next_node)
+                return &edge;
+        }
+
+        return nullptr;
+    }
+
+    std::complex<double> voronoi_path::edgeTerm(const GraphNode &from, const GraphNode &to, std::vector<std::pair<int, int>> *crossings)
+    {
+        //Edges can only cross the cuts of centers with y in (min y, max y] of the edge, most edges are short so only a few
+        //centers are checked. Same test as segmentCrossings
+        double ax = from.x;
+        double ay = from.y;
+        double bx = to.x;
+        double by = to.y;
+        auto center_it = std::upper_bound(centers_by_y.begin(), centers_by_y.end(), std::make_pair(std::min(ay, by), std::numeric_limits<int>::max()));
+
+        std::complex<double> sum;
+        for (; center_it != centers_by_y.end() && center_it->first <= std::max(ay, by); ++center_it)
+        {
+            int j = center_it->second;
+            double uy = ay - center_y[j];
+            double vy = by - center_y[j];
+            double cross = (ax - center_x[j]) * vy - uy * (bx - center_x[j]);
+            int count = (uy >= 0 && vy < 0 && cross > 0) - (uy < 0 && vy >= 0 && cross < 0);
+            if (count == 0)
+                continue;
+
+            sum += obs_coeff[j] * static_cast<double>(count);
+            if (crossings)
+                crossings->emplace_back(j, count);
+        }
+
+        return std::complex<double>(0, 2 * M_PI) * sum;
+    }
+
+    void voronoi_path::updateGraphFaces()
+    {
+        graph_faces.clear();
+
+        //Directed edges are numbered by node, edge i of a node is first_edge[node] + i
+        std::vector<int> first_edge(adj_list.size() + 1, 0);
+        for (int node = 0; node < adj_list.size(); ++node)
+            first_edge[node + 1] = first_edge[node] + adj_list[node].size();
+
+        int num_edges = first_edge.back();
+        std::vector<int> edge_source(num_edges);
+
+        //Nodes closer than a hundredth of a cell are one vertex of the embedding, the direction between them is only rounding
+        std::vector<int> &vertex = node_vertices;
+        vertex.resize(adj_list.size());
+        for (int node = 0; node < adj_list.size(); ++node)
+            vertex[node] = node;
+
+        auto find_vertex = [&vertex](int node) {
+            while (vertex[node] != node)
+                node = vertex[node] = vertex[vertex[node]];
+
+            return node;
+        };
+
+        for (int node = 0; node < adj_list.size(); ++node)
+        {
+            for (const auto &next : adj_list[node])
+            {
+                if (pow(node_inf[next].x - node_inf[node].x, 2) + pow(node_inf[next].y - node_inf[node].y, 2) < 1e-4)
+                    vertex[find_vertex(node)] = find_vertex(next);
+            }
+        }
+
+        for (int node = 0; node < adj_list.size(); ++node)
+            vertex[node] = find_vertex(node);
+
+        //Edges leaving each vertex to another vertex, grouped by vertex
+        std::vector<int> vertex_begin(adj_list.size() + 1, 0);
+        for (int node = 0; node < adj_list.size(); ++node)
+        {
+            for (int i = 0; i < adj_list[node].size(); ++i)
+            {
+                edge_source[first_edge[node] + i] = node;
+                if (vertex[node] != vertex[adj_list[node][i]])
+                    ++vertex_begin[vertex[node] + 1];
+            }
+        }
+
+        for (int v = 0; v < adj_list.size(); ++v)
+            vertex_begin[v + 1] += vertex_begin[v];
+
+        std::vector<std::pair<double, int>> rotation(vertex_begin.back());
+        std::vector<int> vertex_end(vertex_begin.begin(), vertex_begin.end() - 1);
+        for (int node = 0; node < adj_list.size(); ++node)
+        {
+            for (int i = 0; i < adj_list[node].size(); ++i)
+            {
+                if (vertex[node] != vertex[adj_list[node][i]])
+                    rotation[vertex_end[vertex[node]]++] = std::make_pair(0.0, first_edge[node] + i);
+            }
+        }
 
-            //Order of paths < num_paths must be maintained
-            //If max element is greater than or equal to num_paths limit, means it is a potential path, just delete
-            if (ind >= num_paths)
+        auto edge_target = [&](int edge) {
+            int node = edge_source[edge];
+            return vertex[adj_list[node][edge - first_edge[node]]];
+        };
+
+        //Only the first edge from a vertex to each other vertex is part of the embedding, paired with the first edge back.
+        //Edges without one back are not part of any face
+        std::vector<int> reverse(num_edges, -1);
+        for (int v = 0; v < adj_list.size(); ++v)
+        {
+            for (int k = vertex_begin[v]; k < vertex_end[v]; ++k)
             {
-                all_paths_cost.erase(max_it);
-                replanned_paths.erase(replanned_paths.begin() + ind);
+                int edge = rotation[k].second;
+                int target = edge_target(edge);
+                bool is_first = true;
+                for (int other = vertex_begin[v]; other < k && is_first; ++other)
+                    is_first = edge_target(rotation[other].second) != target;
+
+                for (int back = vertex_begin[target]; back < vertex_end[target] && is_first; ++back)
+                {
+                    if (edge_target(rotation[back].second) == v)
+                    {
+                        reverse[edge] = rotation[back].second;
+                        break;
+                    }
+                }
             }
+        }
 
-            //Path is < num_paths, swap with one of the paths behind and then delete last
-            else
+        //Sort the remaining edges of each vertex counter-clockwise and store the position of each edge in that order. Any
+        //order of up to two edges is counter-clockwise, which most Voronoi vertices have
+        std::vector<int> rotation_rank(num_edges, -1);
+        for (int v = 0; v < adj_list.size(); ++v)
+        {
+            auto begin = rotation.begin() + vertex_begin[v];
+            auto end = std::remove_if(begin, rotation.begin() + vertex_end[v], [&reverse](const std::pair<double, int> &edge) {
+                return reverse[edge.second] == -1;
+            });
+            vertex_end[v] = end - rotation.begin();
+
+            if (end - begin > 2)
             {
-                std::swap(replanned_paths[ind], replanned_paths[replanned_paths.size() - 1]);
-                std::swap(all_paths_cost[ind], all_paths_cost[all_paths_cost.size() - 1]);
+                for (auto edge_it = begin; edge_it != end; ++edge_it)
+                {
+                    int node = edge_source[edge_it->second];
+                    const GraphNode &next = node_inf[adj_list[node][edge_it->second - first_edge[node]]];
+                    edge_it->first = std::atan2(next.y - node_inf[node].y, next.x - node_inf[node].x);
+                }
 
-                replanned_paths.pop_back();
-                all_paths_cost.pop_back();
+                std::sort(begin, end);
             }
+
+            for (auto edge_it = begin; edge_it != end; ++edge_it)
+                rotation_rank[edge_it->second] = edge_it - begin;
         }
 
-        //Restore pref path cost
-        all_paths_cost[pref_path] = pref_path_cost;
+        //Walk each face with it on the left, after arriving at a vertex leave by the next edge clockwise from the one arrived by
+        std::vector<int> face_of(num_edges, -1);
+        std::vector<std::vector<int>> boundaries;
+        for (int start = 0; start < num_edges; ++start)
+        {
+            if (reverse[start] == -1 || face_of[start] != -1)
+                continue;
 
-        //Update previous paths and their costs for the next round of replanning
-        previous_paths = replanned_paths;
-        previous_path_costs = all_paths_cost;
+            int face = graph_faces.size();
+            graph_faces.push_back(GraphFace());
+            boundaries.push_back(std::vector<int>());
+            std::vector<int> &boundary = graph_faces[face].boundary;
+            for (int edge = start; face_of[edge] == -1;)
+            {
+                face_of[edge] = face;
+                boundaries[face].push_back(edge);
 
-        if (print_timings)
-            complete_profiler.print("replan total replan time");
+                int node = edge_source[edge];
+                if (boundary.empty() || boundary.back() != node)
+                    boundary.push_back(node);
 
-        return replanned_paths;
-    }
+                boundary.push_back(adj_list[node][edge - first_edge[node]]);
+                int next_vertex = vertex[boundary.back()];
+                int degree = vertex_end[next_vertex] - vertex_begin[next_vertex];
+                edge = rotation[vertex_begin[next_vertex] + (rotation_rank[reverse[edge]] + degree - 1) % degree].second;
+            }
 
-    bool voronoi_path::getNearestNode(const GraphNode &start, const GraphNode &end, int &start_node, int &end_node)
-    {
-        //TODO: Should not only check nearest nodes. Should allow nearest position to be on an edge
-        double min_start_dist = std::numeric_limits<double>::infinity();
-        double min_end_dist = std::numeric_limits<double>::infinity();
-        start_node = -1;
-        end_node = -1;
+            if (boundary.back() == boundary.front())
+                boundary.pop_back();
 
-        //Traverse all nodes to find the one with minimum distance from start and end points
-        for (int i = 0; i < num_nodes; ++i)
+            for (int i = 0; i < boundary.size(); ++i)
+            {
+                const GraphNode &point = node_inf[boundary[i]];
+                const GraphNode &next = node_inf[boundary[(i + 1) % boundary.size()]];
+                graph_faces[face].area += (point.x * next.y - next.x * point.y) / 2;
+            }
+        }
+
+        //The outer face of a connected component is the one traced clockwise, which has the smallest area
+        std::vector<bool> visited(graph_faces.size(), false);
+        std::vector<int> component;
+        std::queue<int> queue;
+        for (int first = 0; first < graph_faces.size(); ++first)
         {
-            if (adj_list[i].empty())
+            if (visited[first])
                 continue;
 
-            GraphNode curr = node_inf[i];
-            double temp_start_dist = pow(curr.x - start.x, 2) + pow(curr.y - start.y, 2);
-            if (temp_start_dist < min_start_dist)
+            component.clear();
+            visited[first] = true;
+            queue.push(first);
+            while (!queue.empty())
             {
-                if (!edgeCollides(start, curr, collision_threshold))
+                int face = queue.front();
+                queue.pop();
+                component.push_back(face);
+                for (const auto &edge : boundaries[face])
                 {
-                    min_start_dist = temp_start_dist;
-                    start_node = i;
+                    int other = face_of[reverse[edge]];
+                    if (!visited[other])
+                    {
+                        visited[other] = true;
+                        queue.push(other);
+                    }
                 }
             }
 
-            double temp_end_dist = pow(curr.x - end.x, 2) + pow(curr.y - end.y, 2);
-            if (temp_end_dist < min_end_dist)
+            int outer = *std::min_element(component.begin(), component.end(), [this](int a, int b) {
+                return graph_faces[a].area < graph_faces[b].area;
+            });
+
+            //Breadth first from the outer face keeps cuts short
+            for (const auto &face : component)
+                visited[face] = false;
+
+            visited[outer] = true;
+            queue.push(outer);
+            while (!queue.empty())
             {
-                if (!edgeCollides(end, curr, collision_threshold))
+                int face = queue.front();
+                queue.pop();
+                for (const auto &edge : boundaries[face])
                 {
-                    min_end_dist = temp_end_dist;
-                    end_node = i;
+                    int other = face_of[reverse[edge]];
+                    if (visited[other])
+                        continue;
+
+                    visited[other] = true;
+                    graph_faces[other].parent = face;
+                    graph_faces[other].edge_node = edge_source[reverse[edge]];
+                    graph_faces[other].edge_next = edge_source[edge];
+                    queue.push(other);
                 }
             }
         }
-
-        //Failed to find start/end even after relaxation
-        if (start_node == -1 || end_node == -1)
-        {
-            std::cout << "Failed to find nearest starting or ending node" << std::endl;
-            return false;
-        }
-
-        return true;
     }
 
-    std::vector<GraphNode> voronoi_path::convertToPixelPath(const std::vector<int> &path_)
+    void voronoi_path::updateEdgeHomotopy()
     {
-        std::vector<GraphNode> return_path;
-        return_path.reserve(path_.size());
-        for (const auto &node : path_)
-            return_path.emplace_back(node_inf[node].x, node_inf[node].y);
+        edge_homotopy.resize(adj_list.size());
+        edge_crossings.clear();
+        node_potentials.clear();
 
-        return return_path;
-    }
+        centers_by_y.clear();
+        for (int j = 0; j < centers.size(); ++j)
+            centers_by_y.emplace_back(center_y[j], j);
 
-    //https://www.cs.huji.ac.il/~jeff/aaai10/02/AAAI10-216.pdf
-    std::complex<double> voronoi_path::calcHomotopyClass(const std::vector<GraphNode> &path_)
-    {
-        std::vector<std::complex<double>> path;
-        path.reserve(path_.size());
+        std::sort(centers_by_y.begin(), centers_by_y.end());
 
-        //Convert path to complex path
-        for (const auto &node : path_)
-            path.emplace_back(node.x, node.y);
+        //Crossings of the cuts from the face of each obstacle to its outer face, by edge from the lower to the higher vertex
+        std::unordered_map<uint64_t, std::vector<std::pair<int, int>>> cut_crossings;
+        if (use_face_classes)
+        {
+            //Boundaries of bounded faces wind once around the points inside them, sum branch cut crossings around each face
+            std::map<std::pair<int, int>, int> face_windings;
+            std::vector<std::pair<int, int>> crossings;
+            for (int face = 0; face < graph_faces.size(); ++face)
+            {
+                const std::vector<int> &boundary = graph_faces[face].boundary;
+                crossings.clear();
+                for (int i = 0; i < boundary.size(); ++i)
+                    edgeTerm(node_inf[boundary[i]], node_inf[boundary[(i + 1) % boundary.size()]], &crossings);
+
+                for (const auto &crossing : crossings)
+                    face_windings[std::make_pair(face, crossing.first)] += crossing.second;
+            }
 
-        //Go through each edge of the path and calculate its homotopy value
-        std::complex<double> path_sum(0, 0);
-        int num_threads = std::thread::hardware_concurrency();
-        std::vector<std::future<std::complex<double>>> future_vector;
-        future_vector.reserve(num_threads);
+            for (const auto &face_winding : face_windings)
+            {
+                int face = face_winding.first.first;
+                if (face_winding.second <= 0 || graph_faces[face].parent == -1)
+                    continue;
 
-        int poses_per_thread = path.size() / num_threads;
+                //A cut crosses the edge shared with the parent face, going around the face counter-clockwise crosses it
+                //along the edge
+                int center = face_winding.first.second;
+                for (; graph_faces[face].parent != -1; face = graph_faces[face].parent)
+                {
+                    int vertex = node_vertices[graph_faces[face].edge_node];
+                    int next_vertex = node_vertices[graph_faces[face].edge_next];
+                    uint64_t key = (static_cast<uint64_t>(std::min(vertex, next_vertex)) << 32) | static_cast<uint32_t>(std::max(vertex, next_vertex));
+                    cut_crossings[key].emplace_back(center, vertex < next_vertex ? 1 : -1);
+                }
+            }
+        }
 
-        for (int i = 0; i < num_threads; ++i)
+        for (int node = 0; node < adj_list.size(); ++node)
         {
-            int start_pose = i * poses_per_thread;
+            std::vector<EdgeHomotopy> &edges = edge_homotopy[node];
+            edges.resize(adj_list[node].size());
+            for (int i = 0; i < adj_list[node].size(); ++i)
+            {
+                EdgeHomotopy &edge = edges[i];
+                edge.node = adj_list[node][i];
 
-            //Last thread takes remaining poses
-            if (i == num_threads - 1)
-                poses_per_thread = path.size() - poses_per_thread * (num_threads - 1);
+                //Reverse of an edge that was already computed only changes sign
+                const EdgeHomotopy *reverse = edge.node < node ? findEdgeHomotopy(edge.node, node) : nullptr;
+                if (reverse)
+                {
+                    edge.term = -reverse->term;
+                    edge.crossings_begin = reverse->crossings_begin;
+                    edge.crossings_end = reverse->crossings_end;
+                    edge.direction = -reverse->direction;
+                    continue;
+                }
 
-            future_vector.emplace_back(std::async(
-                std::launch::async,
-                [&, start_pose, poses_per_thread, path]() {
-                    std::complex<double> path_sum(0, 0);
-                    for (int i = start_pose + 1; i < start_pose + poses_per_thread + 1; i++)
+                edge.crossings_begin = edge_crossings.size();
+                if (use_face_classes)
+                {
+                    //Edges between the same two vertices cross the same cuts
+                    int vertex = node_vertices[node];
+                    int next_vertex = node_vertices[edge.node];
+                    int sign = vertex < next_vertex ? 1 : -1;
+                    auto cut_it = cut_crossings.find((static_cast<uint64_t>(std::min(vertex, next_vertex)) << 32) | static_cast<uint32_t>(std::max(vertex, next_vertex)));
+                    std::complex<double> sum;
+                    if (vertex != next_vertex && cut_it != cut_crossings.end())
                     {
-                        std::complex<double> edge_sum(0, 0);
-                        if (i >= path.size())
-                            continue;
-
-                        //Each edge must iterate through all obstacles
-                        for (int j = 0; j < centers.size(); ++j)
+                        for (const auto &crossing : cut_it->second)
                         {
-                            double real_part = std::log(std::abs(path[i] - centers[j])) - std::log(std::abs(path[i - 1] - centers[j]));
-                            double im_part = std::arg(path[i] - centers[j]) - std::arg(path[i - 1] - centers[j]);
-
-                            //Get smallest angle
-                            while (im_part > M_PI)
-                                im_part -= 2 * M_PI;
-
-                            while (im_part < -M_PI)
-                                im_part += 2 * M_PI;
-
-                            edge_sum += (std::complex<double>(real_part, im_part) * obs_coeff[j]);
+                            sum += obs_coeff[crossing.first] * static_cast<double>(sign * crossing.second);
+                            edge_crossings.emplace_back(crossing.first, sign * crossing.second);
                         }
-                        //Add this edge's sum to the path sum
-                        path_sum += edge_sum;
                     }
 
-                    return path_sum;
-                }));
-        }
+                    edge.term = std::complex<double>(0, 2 * M_PI) * sum;
+                }
 
-        for (int i = 0; i < future_vector.size(); ++i)
-        {
-            std::complex<double> temp_sum = future_vector[i].get();
-            path_sum += temp_sum;
-        }
+                else
+                    edge.term = edgeTerm(node_inf[node], node_inf[edge.node], &edge_crossings);
 
-        return path_sum;
+                edge.crossings_end = edge_crossings.size();
+                edge.direction = 1;
+            }
+        }
     }
 
     bool voronoi_path::kthShortestPaths(const int &start_node, const int &end_node, const std::vector<int> &shortestPath, std::vector<std::vector<int>> &all_paths, const int &num_paths)
@@ -926,9 +2705,19 @@ namespace voronoi_path
         std::vector<std::vector<int>> adj_list_backup(adj_list);
         std::vector<int> adj_list_modified_ind;
 
+        //Candidate kth shortest path, root_terms is the sum of edge terms of the root path it shares with the path it spurred from
+        struct Candidate
+        {
+            double cost;
+            std::vector<int> path;
+            std::complex<double> root_terms;
+            int spur_index;
+        };
+
         //Containers to store candidate kth shortest paths and their costs, and homotopy classes of all accepted paths
-        std::vector<std::pair<double, std::vector<int>>> potentialKth;
-        std::vector<std::complex<double>> homotopy_classes;
+        std::vector<Candidate> potentialKth;
+        HomotopyRegistry registry(use_winding_numbers || use_face_classes, h_class_threshold);
+        std::vector<std::complex<double>> root_terms;
 
         for (int k = 1; k <= num_paths; ++k)
         {
@@ -936,8 +2725,14 @@ namespace voronoi_path
             if (k - 1 == kthPaths.size())
                 break;
 
-            //Update homotopy classes vector whenever new kth path gets added
-            homotopy_classes.push_back(calcHomotopyClass(convertToPixelPath(kthPaths.back())));
+            //Register homotopy class whenever new kth path gets added
+            registry.insert(nodePathClass(kthPaths.back()), k - 1, 0);
+
+            //Edge terms of every root path of the previous kth path, root_terms[i] covers edges up to node i
+            const std::vector<int> &prev_path = kthPaths[k - 1];
+            root_terms.assign(prev_path.size(), std::complex<double>());
+            for (int i = 1; i < prev_path.size(); ++i)
+                root_terms[i] = root_terms[i - 1] + sumEdgeTerms(prev_path, i - 1, i);
 
             //Spur node is ith node, from start to 2nd last node of path, inclusive
             for (int i = 0; i < kthPaths[k - 1].size() - 1; ++i)
@@ -1043,8 +2838,8 @@ namespace voronoi_path
                             //Compare with potentialKths
                             if (check_path < potentialKth.size())
                             {
-                                if (node_pot < potentialKth[check_path].second.size())
-                                    if (potentialKth[check_path].second[node_pot] == total_path[node_pot])
+                                if (node_pot < potentialKth[check_path].path.size())
+                                    if (potentialKth[check_path].path[node_pot] == total_path[node_pot])
                                         pot_equal++;
                             }
                         }
@@ -1063,7 +2858,7 @@ namespace voronoi_path
 
                         //Store path and its corresponding cost as a pair
                         // cost_index_vec.emplace_back(total_cost, potentialKth.size());
-                        potentialKth.emplace_back(total_cost, std::move(total_path));
+                        potentialKth.push_back(Candidate{total_cost, std::move(total_path), root_terms[i], i});
                     }
                 }
 
@@ -1080,31 +2875,25 @@ namespace voronoi_path
                 break;
 
             //Sort costs of paths
-            std::sort(potentialKth.begin(), potentialKth.end());
+            std::sort(potentialKth.begin(), potentialKth.end(), [](const Candidate &a, const Candidate &b) {
+                return a.cost < b.cost || (a.cost == b.cost && a.path < b.path);
+            });
 
-            //Check whether paths are unique and erase non-unique paths, starting from lowest cost path, breaks when lowest cost path is unique
-            auto path_it = potentialKth.begin();
-            int h = 0; //Path is unique if h == homotopy_classes.size()
-            while (path_it < potentialKth.end() && h != homotopy_classes.size())
+            //Erase paths of classes that were already found, starting from lowest cost path, breaks when lowest cost path is unique
+            while (!potentialKth.empty())
             {
-                //Get homotopy class of the path that is currently being considered
-                std::complex<double> curr_h_class = calcHomotopyClass(convertToPixelPath(path_it->second));
-                for (h = 0; h < homotopy_classes.size(); ++h)
-                {
-                    //Path is not unique
-                    if (!isClassDifferent(curr_h_class, homotopy_classes[h]))
-                    {
-                        //Erase and then break if not unique, set path_it to the new iterator of path behind deleted path
-                        path_it = potentialKth.erase(path_it);
-                        break;
-                    }
-                }
+                //Get homotopy class of the path that is currently being considered, only the spur path's edges are summed
+                const Candidate &candidate = potentialKth.front();
+                if (!registry.contains(nodePathClass(candidate.path, candidate.root_terms + sumEdgeTerms(candidate.path, candidate.spur_index, candidate.path.size() - 1))))
+                    break;
+
+                potentialKth.erase(potentialKth.begin());
             }
 
             //If there are remaining unique paths, add the shortest one to kthPaths
             if (!potentialKth.empty())
             {
-                kthPaths.push_back(std::move(potentialKth[0].second));
+                kthPaths.push_back(std::move(potentialKth[0].path));
                 potentialKth.erase(potentialKth.begin());
             }
         }
@@ -1117,7 +2906,142 @@ namespace voronoi_path
             return false;
     }
 
-    bool voronoi_path::findShortestPath(const int &start_node, const int &end_node, std::vector<int> &path)
+    bool voronoi_path::findHomotopyPaths(const int &start_node, const int &end_node, std::vector<std::vector<int>> &all_paths, const int &num_paths)
+    {
+        //State of the search, a node and the class of the path that reached it. windings indexes the cut crossings summed over
+        //the path in state_windings, which identify the class exactly since all paths share the start. terms is the sum of
+        //edge terms for the H-signature. jump_state is an ancestor on the path, placed so that the state at any depth is found
+        //in O(log depth) jumps
+        struct SearchState
+        {
+            int node;
+            int prev_state;
+            int jump_state;
+            int depth;
+            double cost_upto_here;
+            std::complex<double> terms;
+            int windings;
+            uint64_t windings_hash;
+        };
+
+        std::vector<SearchState> states;
+        states.push_back(SearchState{start_node, -1, 0, 0, 0, std::complex<double>(), 0, 0});
+
+        //(center index, count) pairs sorted by center, shared by states until an edge crosses a cut. The hash is a sum over
+        //the pairs so it is updated per edge, equal crossings always have equal hashes
+        std::vector<std::vector<std::pair<int, int>>> state_windings(1);
+        auto center_key = [](int center) {
+            uint64_t key = static_cast<uint64_t>(center) + 0x9e3779b97f4a7c15ULL;
+            key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            key = (key ^ (key >> 27)) * 0x94d049bb133111ebULL;
+            return key ^ (key >> 31);
+        };
+        auto same_class = [&](const SearchState &a, const SearchState &b) {
+            return a.windings == b.windings || (a.windings_hash == b.windings_hash && state_windings[a.windings] == state_windings[b.windings]);
+        };
+
+        auto ancestor = [&](int state_ind, int depth) {
+            while (states[state_ind].depth > depth)
+                state_ind = states[states[state_ind].jump_state].depth >= depth ? states[state_ind].jump_state : states[state_ind].prev_state;
+
+            return state_ind;
+        };
+
+        //Open list ordered by ascending total cost, holds indices into states
+        typedef std::pair<double, int> OpenEntry;
+        std::priority_queue<OpenEntry, std::vector<OpenEntry>, std::greater<OpenEntry>> open_list;
+        open_list.emplace(euclideanDist(node_inf[start_node], node_inf[end_node]), 0);
+
+        //States each node was closed with, one per class. If a node was closed with num_paths classes, a path through it in
+        //another class is more expensive than num_paths paths of distinct classes that share its remainder to the goal.
+        //Approximate, the closed states' paths may not be able to take that remainder without visiting a node twice
+        std::vector<std::vector<int>> closed_states(num_nodes);
+        HomotopyRegistry registry(use_winding_numbers || use_face_classes, h_class_threshold);
+        std::vector<int> node_path;
+        GraphNode end_node_location = node_inf[end_node];
+        while (!open_list.empty() && all_paths.size() < num_paths)
+        {
+            int state_ind = open_list.top().second;
+            open_list.pop();
+            SearchState state = states[state_ind];
+
+            //Classes are compared by their crossings, H-signatures of distinct classes can be arbitrarily close. Paths only
+            //visit each node once, the node is on the path if a state it was closed with is an ancestor
+            std::vector<int> &closed = closed_states[state.node];
+            bool is_closed = state.node != end_node && closed.size() >= num_paths;
+            for (int i = 0; i < closed.size() && !is_closed; ++i)
+            {
+                const SearchState &closed_state = states[closed[i]];
+                is_closed = same_class(closed_state, state) ||
+                            (closed_state.depth < state.depth && ancestor(state_ind, closed_state.depth) == closed[i]);
+            }
+
+            if (is_closed)
+                continue;
+
+            closed.push_back(state_ind);
+
+            //Backtrack path to goal, keep it if its class is different from all paths found so far
+            if (state.node == end_node)
+            {
+                node_path.resize(state.depth + 1);
+                for (int i = state_ind; i != -1; i = states[i].prev_state)
+                    node_path[states[i].depth] = states[i].node;
+
+                if (registry.insert(nodePathClass(node_path, state.terms), all_paths.size(), state.cost_upto_here))
+                    all_paths.push_back(node_path);
+
+                continue;
+            }
+
+            //Skew-binary jump pointers, jump two levels up if both jumps below span the same number of states
+            int jump_state = state_ind;
+            int jump_1 = state.jump_state;
+            int jump_2 = states[jump_1].jump_state;
+            if (state.depth - states[jump_1].depth == states[jump_1].depth - states[jump_2].depth)
+                jump_state = jump_2;
+
+            int prev_node = state.prev_state == -1 ? -1 : states[state.prev_state].node;
+            for (const auto &edge : edge_homotopy[state.node])
+            {
+                if (edge.node == prev_node)
+                    continue;
+
+                //Edges that cross no cut keep the class of the state
+                int windings = state.windings;
+                uint64_t windings_hash = state.windings_hash;
+                if (edge.crossings_begin != edge.crossings_end)
+                {
+                    std::vector<std::pair<int, int>> sum = state_windings[state.windings];
+                    for (int k = edge.crossings_begin; k < edge.crossings_end; ++k)
+                    {
+                        int center = edge_crossings[k].first;
+                        int count = edge.direction * edge_crossings[k].second;
+                        windings_hash += static_cast<uint64_t>(static_cast<int64_t>(count)) * center_key(center);
+                        auto winding_it = std::lower_bound(sum.begin(), sum.end(), std::make_pair(center, std::numeric_limits<int>::min()));
+                        if (winding_it == sum.end() || winding_it->first != center)
+                            sum.insert(winding_it, std::make_pair(center, count));
+
+                        else if ((winding_it->second += count) == 0)
+                            sum.erase(winding_it);
+                    }
+
+                    windings = state_windings.size();
+                    state_windings.push_back(std::move(sum));
+                }
+
+                GraphNode next_node_location = node_inf[edge.node];
+                double cost_upto_here = state.cost_upto_here + euclideanDist(node_inf[state.node], next_node_location);
+                states.push_back(SearchState{edge.node, state_ind, jump_state, state.depth + 1, cost_upto_here, state.terms + edge.term,
+                                             windings, windings_hash});
+                open_list.emplace(cost_upto_here + euclideanDist(end_node_location, next_node_location), states.size() - 1);
+            }
+        }
+
+        return all_paths.size() == num_paths;
+    }
+
+    bool voronoi_path::findShortestPath(const int &start_node, const int &end_node, std::vector<int> &path, const std::vector<bool> *node_mask)
     {
         //Create open list, boolean closed_list, and list storing previous node required to reach node at index i
         std::vector<std::pair<int, NodeInfo>> open_list;
@@ -1153,8 +3077,8 @@ namespace voronoi_path
             {
                 next_node = adj_list[curr_node][i];
 
-                //Edge has been deleted or node is already in closed list
-                if (next_node == -1 || nodes_closed_bool[next_node])
+                //Edge has been deleted, node is already in closed list or node is excluded by mask
+                if (next_node == -1 || nodes_closed_bool[next_node] || (node_mask && !(*node_mask)[next_node]))
                     continue;
 
                 //Get the location of the next node
@@ -1252,10 +3176,10 @@ namespace voronoi_path
             //Check each vertex if is inside obstacle
             for (int j = 0; j < 2; ++j)
             {
-                int pixel = floor(edge_vector[i]->pos[j].x) + floor(edge_vector[i]->pos[j].y) * map_ptr->width;
+                signed char cost = map_ptr->getCost(floor(edge_vector[i]->pos[j].x), floor(edge_vector[i]->pos[j].y));
 
                 //If vertex pixel in map is not free, remove this edge
-                if (map_ptr->data[pixel] > collision_threshold || map_ptr->data[pixel] == -1)
+                if (cost > collision_threshold || cost == -1)
                 {
                     delete_indices.push_back(i);
                     break;
@@ -1367,19 +3291,22 @@ namespace voronoi_path
 
     bool voronoi_path::edgeCollides(const GraphNode &start, const GraphNode &end, int threshold)
     {
+        MapRect map_rect(0, 0, map_ptr->width, map_ptr->height);
+
         //Check start and end cells first
-        try
+        int start_x = floor(start.x), start_y = floor(start.y);
+        int end_x = floor(end.x), end_y = floor(end.y);
+        if (!map_rect.contains(start_x, start_y) || !map_rect.contains(end_x, end_y))
+            std::cout << "Edge collision checking start or end cell is outside of map" << std::endl;
+
+        else
         {
-            if (map_ptr->data.at(floor(start.x) + floor(start.y) * map_ptr->width) > threshold)
+            if (map_ptr->getCost(start_x, start_y) > threshold)
                 return true;
 
-            if (map_ptr->data.at(floor(end.x) + floor(end.y) * map_ptr->width) > threshold)
+            if (map_ptr->getCost(end_x, end_y) > threshold)
                 return true;
         }
-        catch (const std::exception &e)
-        {
-            std::cout << "Exception occurred with edge collision checking, " << e.what() << std::endl;
-        }
 
         double steps = 0;
         double distance = sqrt(pow(start.x - end.x, 2) + pow(start.y - end.y, 2));
@@ -1393,27 +3320,233 @@ namespace voronoi_path
         //Calculate linear increment in x and y to reduce computation costs
         double increment_x = (end.x - start.x) / (double)steps;
         double increment_y = (end.y - start.y) / (double)steps;
-        GraphNode curr_node = start;
 
-        for (int i = 0; i <= steps; ++i)
+        //Pyramid and bitplanes only hold map cells within the planning window as of the last mapToGraph
+        //Cells under the overlay, outside of the window or changed since then are read directly
+        MapRect segment_rect(std::min(start_x, end_x), std::min(start_y, end_y), abs(end_x - start_x) + 1, abs(end_y - start_y) + 1);
+        bool use_pyramid = pyramid_map_width == map_ptr->width && pyramid_map_height == map_ptr->height &&
+                           planning_window.contains(segment_rect) && !segment_rect.intersects(map_ptr->overlay.rect);
+        for (const auto &dirty : map_ptr->dirty_rects)
+        {
+            if (segment_rect.intersects(dirty))
+                use_pyramid = false;
+        }
+
+        const std::vector<uint64_t> *plane = use_pyramid ? getBitplane(threshold) : nullptr;
+
+        for (int i = 0; i <= steps;)
         {
-            int pixel = floor(curr_node.x) + floor(curr_node.y) * map_ptr->width;
-            curr_node.x += increment_x;
-            curr_node.y += increment_y;
+            int pixel_x = floor(start.x + i * increment_x);
+            int pixel_y = floor(start.y + i * increment_y);
 
             //Double check the pixel is in range of map data
-            if (pixel < map_ptr->data.size())
+            if (!map_rect.contains(pixel_x, pixel_y))
+                break;
+
+            //Jump over samples lying in free tiles
+            if (use_pyramid)
+            {
+                int next_step = skipFreeTiles(start, increment_x, increment_y, i, pixel_x, pixel_y, threshold);
+                if (next_step != i)
+                {
+                    i = next_step;
+                    continue;
+                }
+            }
+
+            if (plane)
             {
-                if (map_ptr->data[pixel] > threshold)
+                if ((*plane)[pixel_y * bitplane_words_per_row + (pixel_x >> 6)] >> (pixel_x & 63) & 1)
                     return true;
             }
 
-            else
-                break;
+            else if (map_ptr->getCost(pixel_x, pixel_y) > threshold)
+                return true;
+
+            ++i;
         }
         return false;
     }
 
+    void voronoi_path::updateCostPyramid(const MapRect &region)
+    {
+        int width = map_ptr->width;
+        int height = map_ptr->height;
+        MapRect update_rect = region.intersect(MapRect(0, 0, width, height));
+
+        //Map was resized, reallocate all levels. Tiles outside of region read as free until they are updated
+        if (pyramid_map_width != width || pyramid_map_height != height)
+        {
+            cost_pyramid.assign(PYRAMID_LEVELS, std::vector<signed char>());
+            pyramid_widths.assign(PYRAMID_LEVELS, 0);
+            pyramid_heights.assign(PYRAMID_LEVELS, 0);
+            for (int level = 0; level < PYRAMID_LEVELS; ++level)
+            {
+                int tile_size = 1 << (PYRAMID_SHIFT * (level + 1));
+                pyramid_widths[level] = (width + tile_size - 1) / tile_size;
+                pyramid_heights[level] = (height + tile_size - 1) / tile_size;
+                cost_pyramid[level].assign(pyramid_widths[level] * pyramid_heights[level], std::numeric_limits<signed char>::min());
+            }
+
+            pyramid_map_width = width;
+            pyramid_map_height = height;
+        }
+
+        if (update_rect.empty() || map_ptr->size() != static_cast<size_t>(width) * height)
+            return;
+
+        //Align region to the coarsest tiles, so that every tile touched is recomputed from all of its cells
+        int coarse_size = 1 << (PYRAMID_SHIFT * PYRAMID_LEVELS);
+        int x0 = update_rect.x / coarse_size * coarse_size;
+        int y0 = update_rect.y / coarse_size * coarse_size;
+        int x1 = std::min(width, (update_rect.x + update_rect.width + coarse_size - 1) / coarse_size * coarse_size);
+        int y1 = std::min(height, (update_rect.y + update_rect.height + coarse_size - 1) / coarse_size * coarse_size);
+
+        //Level 0 is pooled directly from map cells
+        std::vector<signed char> &level_0 = cost_pyramid[0];
+        int level_0_width = pyramid_widths[0];
+        for (int tile_y = y0 >> PYRAMID_SHIFT; tile_y < (y1 + (1 << PYRAMID_SHIFT) - 1) >> PYRAMID_SHIFT; ++tile_y)
+        {
+            for (int tile_x = x0 >> PYRAMID_SHIFT; tile_x < (x1 + (1 << PYRAMID_SHIFT) - 1) >> PYRAMID_SHIFT; ++tile_x)
+                level_0[tile_y * level_0_width + tile_x] = std::numeric_limits<signed char>::min();
+        }
+
+        const signed char *map_data = map_ptr->cells();
+        for (int y = y0; y < y1; ++y)
+        {
+            const signed char *row = map_data + y * width;
+            signed char *tile_row = &level_0[(y >> PYRAMID_SHIFT) * level_0_width];
+            for (int x = x0; x < x1; ++x)
+            {
+                signed char &tile = tile_row[x >> PYRAMID_SHIFT];
+                if (row[x] > tile)
+                    tile = row[x];
+            }
+        }
+
+        //Each further level is pooled from the level below
+        for (int level = 1; level < PYRAMID_LEVELS; ++level)
+        {
+            int shift = PYRAMID_SHIFT * (level + 1);
+            int tile_size = 1 << shift;
+            const std::vector<signed char> &below = cost_pyramid[level - 1];
+            int below_width = pyramid_widths[level - 1];
+            int below_height = pyramid_heights[level - 1];
+            for (int tile_y = y0 >> shift; tile_y < (y1 + tile_size - 1) >> shift; ++tile_y)
+            {
+                for (int tile_x = x0 >> shift; tile_x < (x1 + tile_size - 1) >> shift; ++tile_x)
+                {
+                    signed char tile_max = std::numeric_limits<signed char>::min();
+                    int child_x1 = std::min(below_width, (tile_x + 1) << PYRAMID_SHIFT);
+                    int child_y1 = std::min(below_height, (tile_y + 1) << PYRAMID_SHIFT);
+                    for (int child_y = tile_y << PYRAMID_SHIFT; child_y < child_y1; ++child_y)
+                    {
+                        for (int child_x = tile_x << PYRAMID_SHIFT; child_x < child_x1; ++child_x)
+                            tile_max = std::max(tile_max, below[child_y * below_width + child_x]);
+                    }
+
+                    cost_pyramid[level][tile_y * pyramid_widths[level] + tile_x] = tile_max;
+                }
+            }
+        }
+    }
+
+    bool voronoi_path::bitplanesValid()
+    {
+        return bitplane_map_width == map_ptr->width && bitplane_map_height == map_ptr->height &&
+               bitplane_thresholds[OCCUPANCY_PLANE] == occupancy_threshold - 1 &&
+               bitplane_thresholds[COLLISION_PLANE] == collision_threshold &&
+               bitplane_thresholds[TRIMMING_PLANE] == trimming_collision_threshold;
+    }
+
+    void voronoi_path::updateBitplanes(const MapRect &region)
+    {
+        int width = map_ptr->width;
+        int height = map_ptr->height;
+        MapRect update_rect = region.intersect(MapRect(0, 0, width, height));
+
+        //Map was resized or thresholds changed, reallocate all planes. Cells outside of region read as clear until they are updated
+        if (!bitplanesValid())
+        {
+            bitplane_words_per_row = (width + 63) >> 6;
+            for (int plane = 0; plane < NUM_PLANES; ++plane)
+                bitplanes[plane].assign(static_cast<size_t>(bitplane_words_per_row) * height, 0);
+
+            bitplane_thresholds[OCCUPANCY_PLANE] = occupancy_threshold - 1;
+            bitplane_thresholds[COLLISION_PLANE] = collision_threshold;
+            bitplane_thresholds[TRIMMING_PLANE] = trimming_collision_threshold;
+            bitplane_map_width = width;
+            bitplane_map_height = height;
+        }
+
+        if (update_rect.empty() || map_ptr->size() != static_cast<size_t>(width) * height)
+            return;
+
+        //Whole words are rewritten, so the region is widened to multiples of 64 columns
+        int word_0 = update_rect.x >> 6;
+        int word_1 = (update_rect.x + update_rect.width + 63) >> 6;
+        const signed char *map_data = map_ptr->cells();
+        for (int y = update_rect.y; y < update_rect.y + update_rect.height; ++y)
+        {
+            const signed char *row = map_data + y * width;
+            for (int word = word_0; word < word_1; ++word)
+            {
+                int x0 = word << 6;
+                int count = std::min(width - x0, 64);
+                for (int plane = 0; plane < NUM_PLANES; ++plane)
+                    bitplanes[plane][y * bitplane_words_per_row + word] = thresholdMask(row + x0, count, bitplane_thresholds[plane]);
+            }
+        }
+    }
+
+    const std::vector<uint64_t> *voronoi_path::getBitplane(int threshold)
+    {
+        if (!use_bitplanes || !bitplanesValid())
+            return nullptr;
+
+        for (int plane = 0; plane < NUM_PLANES; ++plane)
+        {
+            if (bitplane_thresholds[plane] == threshold)
+                return &bitplanes[plane];
+        }
+
+        return nullptr;
+    }
+
+    int voronoi_path::skipFreeTiles(const GraphNode &start, double increment_x, double increment_y, int step, int pixel_x, int pixel_y, int threshold)
+    {
+        //Start from the coarsest level, the largest free tile containing the sample is skipped
+        for (int level = PYRAMID_LEVELS - 1; level >= 0; --level)
+        {
+            int shift = PYRAMID_SHIFT * (level + 1);
+            int tile_x = pixel_x >> shift;
+            int tile_y = pixel_y >> shift;
+            if (cost_pyramid[level][tile_y * pyramid_widths[level] + tile_x] > threshold)
+                continue;
+
+            //Find the sample at which the line leaves this tile, samples before it are all inside the free tile
+            int tile_size = 1 << shift;
+            double exit_x = std::numeric_limits<double>::infinity();
+            double exit_y = std::numeric_limits<double>::infinity();
+            if (increment_x > 0)
+                exit_x = ((tile_x + 1) * tile_size - start.x) / increment_x;
+
+            else if (increment_x < 0)
+                exit_x = (tile_x * tile_size - start.x) / increment_x;
+
+            if (increment_y > 0)
+                exit_y = ((tile_y + 1) * tile_size - start.y) / increment_y;
+
+            else if (increment_y < 0)
+                exit_y = (tile_y * tile_size - start.y) / increment_y;
+
+            double exit_step = std::min(std::min(exit_x, exit_y), static_cast<double>(std::numeric_limits<int>::max() - 1));
+            return std::max(step + 1, static_cast<int>(floor(exit_step)));
+        }
+
+        return step;
+    }
+
     double voronoi_path::manhattanDist(const GraphNode &a, const GraphNode &b)
     {
         return fabs(a.x - b.x) + fabs(a.y - b.y);
@@ -1480,9 +3613,36 @@ namespace voronoi_path
         return !previous_paths.empty();
     }
 
-    bool voronoi_path::isClassDifferent(const std::complex<double> &complex_1, const std::complex<double> &complex_2)
+    HomotopySignature HomotopyRegistry::signature(const HomotopyClass &h_class)
+    {
+        HomotopySignature quantized;
+        if (use_windings)
+        {
+            quantized.windings = h_class.windings;
+            return quantized;
+        }
+
+        //Paths with the same end points share most of their signature's magnitude, so one grid fits all of them
+        if (step == 0)
+            step = std::abs(h_class.h_signature) > 0 ? threshold * std::abs(h_class.h_signature) : threshold;
+
+        quantized.real = std::llround(h_class.h_signature.real() / step);
+        quantized.imag = std::llround(h_class.h_signature.imag() / step);
+        return quantized;
+    }
+
+    bool HomotopyRegistry::contains(const HomotopyClass &h_class)
     {
-        return std::abs(complex_1 - complex_2) / std::abs(complex_1) > h_class_threshold;
+        return classes.count(signature(h_class)) > 0;
+    }
+
+    bool HomotopyRegistry::insert(const HomotopyClass &h_class, int path, double cost)
+    {
+        auto inserted = classes.emplace(signature(h_class), std::make_pair(cost, path));
+        if (!inserted.second && cost < inserted.first->second.first)
+            inserted.first->second = std::make_pair(cost, path);
+
+        return inserted.second;
     }
 
     bool voronoi_path::removeExcessBranch(std::vector<std::vector<int>> &new_adj_list, double thresh, int curr_node, int prev_node, double cum_dist)
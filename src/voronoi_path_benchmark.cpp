@@ -0,0 +1,800 @@
+#include "voronoi_path.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <random>
+
+/**
+ * Benchmarks and consistency checks of voronoi_path, without ROS. Maps are either a generated warehouse of shelves or a
+ * map_server PGM image. Each benchmark prints median timings, exit code is 1 if any of its checks fail
+ *
+ * Usage: voronoi_path_benchmark <benchmark> [--map file.pgm] [--resolution m] [--obstacles n] [--start x y] [--goal x y]
+ *                               [--num_paths n] [--repeats n] [--seed n] [--timings]
+ **/
+
+namespace
+{
+    struct Options
+    {
+        std::string map_file;
+        double resolution = 0.05;
+        int obstacles = 300;
+        int num_paths = 4;
+        int repeats = 20;
+        int seed = -1;
+        bool print_timings = false;
+        bool has_start = false;
+        bool has_goal = false;
+        voronoi_path::GraphNode start;
+        voronoi_path::GraphNode goal;
+    };
+
+    /**
+     * Rows of shelves split into blocks, each block is one obstacle surrounded by inflated costs. Aisles between blocks
+     * leave many routes of distinct homotopy classes between opposite corners. A positive seed shifts and shortens blocks
+     * at random so that routes of distinct classes are rarely of equal length
+     **/
+    voronoi_path::Map warehouseMap(int num_obstacles, double resolution, int seed)
+    {
+        const int margin = 40, shelf_width = 40, shelf_height = 10, aisle = 30, inflation = 4;
+        int cols = std::max(1, static_cast<int>(std::ceil(std::sqrt(num_obstacles * 2.0))));
+        int rows = std::max(1, (num_obstacles + cols - 1) / cols);
+        int width = 2 * margin + cols * (shelf_width + aisle) - aisle;
+        int height = 2 * margin + rows * (shelf_height + aisle) - aisle;
+
+        std::vector<signed char> cells(width * height, 0);
+        auto fill = [&](int x0, int y0, int x1, int y1, signed char cost) {
+            for (int y = std::max(0, y0); y < std::min(height, y1); ++y)
+            {
+                for (int x = std::max(0, x0); x < std::min(width, x1); ++x)
+                    cells[y * width + x] = std::max(cells[y * width + x], cost);
+            }
+        };
+
+        //Walls around the map
+        fill(0, 0, width, 3, 100);
+        fill(0, height - 3, width, height, 100);
+        fill(0, 0, 3, height, 100);
+        fill(width - 3, 0, width, height, 100);
+
+        std::mt19937 rng(std::max(0, seed));
+        for (int i = 0; i < num_obstacles; ++i)
+        {
+            int x = margin + (i % cols) * (shelf_width + aisle);
+            int y = margin + (i / cols) * (shelf_height + aisle);
+            int block_width = shelf_width;
+
+            //Aisles stay at least 2/3 as wide so no block touches another
+            if (seed > 0)
+            {
+                int shift = rng() % (aisle / 3 + 1);
+                x += shift;
+                block_width = shelf_width / 2 + rng() % (shelf_width / 2 + 1 - shift);
+                y += rng() % (aisle / 3 + 1);
+            }
+
+            fill(x - inflation, y - inflation, x + block_width + inflation, y + shelf_height + inflation, 90);
+            fill(x, y, x + block_width, y + shelf_height, 100);
+        }
+
+        voronoi_path::Map map;
+        map.setData(std::move(cells));
+        map.width = width;
+        map.height = height;
+        map.resolution = resolution;
+        map.frame_id = "map";
+        map.origin.position.x = 0;
+        map.origin.position.y = 0;
+        map.origin.position.z = 0;
+        return map;
+    }
+
+    /**
+     * Read an 8 bit binary PGM as map_server does without negate, dark cells are occupied and grey cells unknown
+     **/
+    bool loadPgm(const std::string &file_name, double resolution, voronoi_path::Map &map)
+    {
+        std::ifstream file(file_name, std::ios::binary);
+        std::string magic;
+        file >> magic;
+        if (magic != "P5")
+            return false;
+
+        //Header fields may be separated by comments
+        int header[3];
+        for (int i = 0; i < 3; ++i)
+        {
+            file >> std::ws;
+            while (file.peek() == '#')
+            {
+                file.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+                file >> std::ws;
+            }
+
+            file >> header[i];
+        }
+
+        file.get();
+        int width = header[0], height = header[1], max_value = header[2];
+        if (!file || width <= 0 || height <= 0 || max_value <= 0 || max_value > 255)
+            return false;
+
+        std::vector<unsigned char> pixels(width * height);
+        file.read(reinterpret_cast<char *>(pixels.data()), pixels.size());
+        if (!file)
+            return false;
+
+        //Image rows start at the top, map rows at the origin
+        std::vector<signed char> cells(width * height);
+        for (int y = 0; y < height; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                double occupancy = (max_value - pixels[(height - 1 - y) * width + x]) / static_cast<double>(max_value);
+                cells[y * width + x] = occupancy > 0.65 ? 100 : (occupancy < 0.196 ? 0 : -1);
+            }
+        }
+
+        map.setData(std::move(cells));
+        map.width = width;
+        map.height = height;
+        map.resolution = resolution;
+        map.frame_id = "map";
+        map.origin.position.x = 0;
+        map.origin.position.y = 0;
+        map.origin.position.z = 0;
+        return true;
+    }
+
+    /**
+     * Free cell closest to a point, searched in growing squares
+     **/
+    voronoi_path::GraphNode nearestFreeCell(const voronoi_path::Map &map, int x, int y)
+    {
+        for (int radius = 0; radius < std::max(map.width, map.height); ++radius)
+        {
+            for (int dy = -radius; dy <= radius; ++dy)
+            {
+                for (int dx = -radius; dx <= radius; ++dx)
+                {
+                    int cx = x + dx, cy = y + dy;
+                    if ((std::abs(dx) == radius || std::abs(dy) == radius) && cx >= 0 && cy >= 0 && cx < map.width &&
+                        cy < map.height && map.getCost(cx, cy) == 0)
+                        return voronoi_path::GraphNode(cx, cy);
+                }
+            }
+        }
+
+        return voronoi_path::GraphNode(x, y);
+    }
+
+    double elapsedMs(const std::chrono::steady_clock::time_point &start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    double median(std::vector<double> values)
+    {
+        if (values.empty())
+            return 0;
+
+        std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+        return values[values.size() / 2];
+    }
+
+    /**
+     * Change the cost of one free cell between 0 and 1, below every threshold. Tile hashes change so the graph is
+     * regenerated, while obstacles and the graph itself stay the same
+     **/
+    void touchMap(voronoi_path::Map &map, const voronoi_path::GraphNode &cell)
+    {
+        signed char cost = map.getCost(cell.x, cell.y) == 0 ? 1 : 0;
+        map.applyPatch(voronoi_path::MapRect(cell.x, cell.y, 1, 1), &cost);
+    }
+
+    /**
+     * Run a planner call with print_timings set and collect the sections its profilers print, in ms by section name.
+     * Bitplane and byte variants of a section share a name
+     **/
+    std::map<std::string, double> sectionTimes(voronoi_path::voronoi_path &planner, const Options &options, const std::function<void()> &call)
+    {
+        std::ostringstream output;
+        std::streambuf *cout_buffer = std::cout.rdbuf(output.rdbuf());
+        planner.print_timings = true;
+        call();
+        planner.print_timings = options.print_timings;
+        std::cout.rdbuf(cout_buffer);
+        if (options.print_timings)
+            std::cout << output.str();
+
+        std::map<std::string, double> times;
+        std::istringstream lines(output.str());
+        std::string line;
+        while (std::getline(lines, line))
+        {
+            size_t separator = line.rfind(": ");
+            if (separator == std::string::npos)
+                continue;
+
+            std::string name = line.substr(0, separator);
+            size_t variant = name.find(" (");
+            if (variant != std::string::npos)
+                name.erase(variant);
+
+            times[name] += std::atof(line.c_str() + separator + 2) * 1000;
+        }
+
+        return times;
+    }
+
+    /**
+     * mapToGraph regeneration and getPath with bitplanes against comparing cost bytes. Besides the totals, the sections
+     * that read the planes are timed on their own: the site scan of fillOccupancyVector, obstacle labelling, edgeCollides
+     * on every Voronoi edge and contractPath. Both must build the same graph
+     **/
+    bool benchmarkBitplanes(const voronoi_path::Map &base_map, const Options &options)
+    {
+        const std::vector<std::pair<std::string, std::string>> kernels = {
+            {"mapToGraph loop map points", "site scan"},
+            {"findObstacleCentroids label region", "labelling"},
+            {"mapToGraph clearing edges", "edge collisions"},
+            {"getPath interpolate and contract", "contraction"},
+            {"mapToGraph update bitplanes", "plane update"}};
+
+        size_t num_nodes[2];
+        for (int use_bitplanes = 1; use_bitplanes >= 0; --use_bitplanes)
+        {
+            voronoi_path::Map map = base_map;
+            voronoi_path::voronoi_path planner;
+            planner.print_timings = options.print_timings;
+            planner.use_bitplanes = use_bitplanes;
+            planner.mapToGraph(&map);
+
+            std::vector<double> build_ms, path_ms;
+            std::vector<std::vector<double>> kernel_ms(kernels.size());
+            for (int i = 0; i < options.repeats; ++i)
+            {
+                touchMap(map, options.start);
+                auto start = std::chrono::steady_clock::now();
+                std::map<std::string, double> times = sectionTimes(planner, options, [&]() { planner.mapToGraph(&map); });
+                build_ms.push_back(elapsedMs(start));
+
+                planner.clearPreviousPaths();
+                start = std::chrono::steady_clock::now();
+                std::map<std::string, double> path_times = sectionTimes(planner, options, [&]() {
+                    planner.getPath(options.start, options.goal, options.num_paths);
+                });
+                path_ms.push_back(elapsedMs(start));
+
+                times.insert(path_times.begin(), path_times.end());
+                for (int k = 0; k < kernels.size(); ++k)
+                    kernel_ms[k].push_back(times[kernels[k].first]);
+            }
+
+            num_nodes[use_bitplanes] = planner.getNodeInfo().size();
+            std::cout << (use_bitplanes ? "bitplanes" : "bytes    ") << " mapToGraph " << median(build_ms) << " ms, getPath "
+                      << median(path_ms) << " ms, " << num_nodes[use_bitplanes] << " nodes" << std::endl
+                      << "         ";
+
+            for (int k = 0; k < kernels.size(); ++k)
+                std::cout << " " << kernels[k].second << " " << median(kernel_ms[k]) << " ms" << (k + 1 < kernels.size() ? "," : "");
+
+            std::cout << std::endl;
+        }
+
+        bool same_graph = num_nodes[0] == num_nodes[1];
+        if (!same_graph)
+            std::cout << "FAIL bitplanes and bytes built different graphs" << std::endl;
+
+        return same_graph;
+    }
+
+    /**
+     * getPath and calcHomotopyClass with H-signatures against winding numbers. Paths found with winding numbers must have
+     * distinct windings, pairs of them whose H-signatures are within h_class_threshold are reported
+     **/
+    bool benchmarkInvariants(const voronoi_path::Map &base_map, const Options &options)
+    {
+        bool passed = true;
+        for (int use_winding_numbers = 0; use_winding_numbers <= 1; ++use_winding_numbers)
+        {
+            voronoi_path::Map map = base_map;
+            voronoi_path::voronoi_path planner;
+            planner.print_timings = options.print_timings;
+            planner.use_winding_numbers = use_winding_numbers;
+            planner.mapToGraph(&map);
+
+            std::vector<double> path_ms;
+            std::vector<voronoi_path::Path> paths;
+            for (int i = 0; i < options.repeats; ++i)
+            {
+                planner.clearPreviousPaths();
+                auto start = std::chrono::steady_clock::now();
+                paths = planner.getPath(options.start, options.goal, options.num_paths);
+                path_ms.push_back(elapsedMs(start));
+            }
+
+            std::vector<double> class_us;
+            std::vector<voronoi_path::HomotopyClass> classes(paths.size());
+            for (int i = 0; i < options.repeats; ++i)
+            {
+                for (int j = 0; j < paths.size(); ++j)
+                {
+                    auto start = std::chrono::steady_clock::now();
+                    classes[j] = planner.calcHomotopyClass(paths[j].path);
+                    class_us.push_back(elapsedMs(start) * 1000);
+                }
+            }
+
+            std::vector<voronoi_path::GraphNode> centroids;
+            planner.getObstacleCentroids(centroids);
+            std::cout << (use_winding_numbers ? "winding numbers" : "H-signature    ") << " getPath " << median(path_ms) << " ms, "
+                      << paths.size() << " paths, calcHomotopyClass " << median(class_us) << " us per path with "
+                      << centroids.size() << " obstacles" << std::endl;
+
+            if (!use_winding_numbers)
+                continue;
+
+            int merged = 0;
+            for (int j = 0; j < classes.size(); ++j)
+            {
+                for (int k = j + 1; k < classes.size(); ++k)
+                {
+                    if (classes[j].windings == classes[k].windings)
+                    {
+                        std::cout << "FAIL paths " << j << " and " << k << " have the same winding numbers" << std::endl;
+                        passed = false;
+                    }
+
+                    else if (std::abs(classes[j].h_signature - classes[k].h_signature) <
+                             planner.h_class_threshold * std::abs(classes[j].h_signature))
+                        ++merged;
+                }
+            }
+
+            std::cout << merged << " pairs of these paths have H-signatures within h_class_threshold" << std::endl;
+        }
+
+        return passed;
+    }
+
+    /**
+     * Winding numbers of a path closed from its end back to its start around every centroid, summing the log and the
+     * angle of every segment for every centroid as calcHomotopyClass did before it counted branch cut crossings
+     **/
+    std::vector<int> referenceWindings(const std::vector<voronoi_path::GraphNode> &path, const std::vector<voronoi_path::GraphNode> &centroids,
+                                       double &log_sum)
+    {
+        std::vector<int> windings(centroids.size(), 0);
+        for (int j = 0; j < centroids.size(); ++j)
+        {
+            std::complex<double> center(centroids[j].x, centroids[j].y);
+            double angle = 0;
+            for (int i = 1; i <= path.size(); ++i)
+            {
+                const voronoi_path::GraphNode &a = path[i - 1];
+                const voronoi_path::GraphNode &b = path[i % path.size()];
+                std::complex<double> from = std::complex<double>(a.x, a.y) - center;
+                std::complex<double> to = std::complex<double>(b.x, b.y) - center;
+                log_sum += std::log(std::abs(to)) - std::log(std::abs(from));
+
+                double turn = std::arg(to) - std::arg(from);
+                while (turn > M_PI)
+                    turn -= 2 * M_PI;
+
+                while (turn < -M_PI)
+                    turn += 2 * M_PI;
+
+                angle += turn;
+            }
+
+            windings[j] = std::lround(angle / (2 * M_PI));
+        }
+
+        return windings;
+    }
+
+    /**
+     * calcHomotopyClass against the per segment log and angle kernel it replaced, on the paths of getPath. Both must give
+     * the same winding numbers
+     **/
+    bool benchmarkClasses(const voronoi_path::Map &base_map, const Options &options)
+    {
+        voronoi_path::Map map = base_map;
+        voronoi_path::voronoi_path planner;
+        planner.print_timings = options.print_timings;
+        planner.mapToGraph(&map);
+        std::vector<voronoi_path::Path> paths = planner.getPath(options.start, options.goal, options.num_paths);
+
+        //Without a homotopy corridor, classes use every significant obstacle in ascending ID order like the centroids
+        std::vector<voronoi_path::GraphNode> centroids;
+        planner.getObstacleCentroids(centroids);
+
+        bool passed = true;
+        double log_sum = 0;
+        for (int j = 0; j < paths.size(); ++j)
+        {
+            std::vector<double> kernel_us, reference_us;
+            voronoi_path::HomotopyClass h_class;
+            std::vector<int> reference;
+            for (int i = 0; i < options.repeats; ++i)
+            {
+                auto start = std::chrono::steady_clock::now();
+                h_class = planner.calcHomotopyClass(paths[j].path);
+                kernel_us.push_back(elapsedMs(start) * 1000);
+
+                start = std::chrono::steady_clock::now();
+                reference = referenceWindings(paths[j].path, centroids, log_sum);
+                reference_us.push_back(elapsedMs(start) * 1000);
+            }
+
+            std::vector<int> windings, reference_windings;
+            for (const auto &winding : h_class.windings)
+                windings.push_back(winding.second);
+
+            for (int winding : reference)
+            {
+                if (winding != 0)
+                    reference_windings.push_back(winding);
+            }
+
+            std::cout << "path " << j << ", " << paths[j].path.size() << " points, " << centroids.size() << " obstacles: calcHomotopyClass "
+                      << median(kernel_us) << " us, log and angle per segment " << median(reference_us) << " us" << std::endl;
+
+            if (windings != reference_windings)
+            {
+                std::cout << "FAIL path " << j << " winding numbers differ from the reference" << std::endl;
+                passed = false;
+            }
+        }
+
+        //Also keeps the log terms of the reference from being optimized away
+        if (!std::isfinite(log_sum))
+            std::cout << "A path point lies on an obstacle point, reference log terms are not finite" << std::endl;
+
+        return passed;
+    }
+
+    double pathLength(const std::vector<voronoi_path::GraphNode> &path)
+    {
+        double length = 0;
+        for (int i = 1; i < path.size(); ++i)
+            length += std::hypot(path[i].x - path[i - 1].x, path[i].y - path[i - 1].y);
+
+        return length;
+    }
+
+    /**
+     * getPath with use_homotopy_search against Yen's k shortest paths. Graph paths of both are compared by their cost before
+     * contraction. The search must return distinct classes, and neither may leave out a class the other found cheaper than
+     * its own most expensive path, or return fewer paths than asked for while the other found more classes
+     **/
+    bool benchmarkSearch(const voronoi_path::Map &base_map, const Options &options)
+    {
+        const char *names[2] = {"Yen", "search"};
+        std::vector<double> costs[2];
+        std::vector<voronoi_path::HomotopyClass> classes[2];
+        voronoi_path::Map map = base_map;
+        voronoi_path::voronoi_path planners[2];
+        for (int use_homotopy_search = 0; use_homotopy_search <= 1; ++use_homotopy_search)
+        {
+            voronoi_path::voronoi_path &planner = planners[use_homotopy_search];
+            planner.print_timings = options.print_timings;
+            planner.use_homotopy_search = use_homotopy_search;
+            planner.mapToGraph(&map);
+
+            std::vector<double> path_ms;
+            std::vector<voronoi_path::Path> paths;
+            for (int i = 0; i < options.repeats; ++i)
+            {
+                planner.clearPreviousPaths();
+                auto start = std::chrono::steady_clock::now();
+                paths = planner.getPath(options.start, options.goal, options.num_paths);
+                path_ms.push_back(elapsedMs(start));
+            }
+
+            std::cout << (use_homotopy_search ? "homotopy search" : "Yen            ") << " getPath " << median(path_ms) << " ms, "
+                      << paths.size() << " paths, lengths";
+
+            for (const auto &path : paths)
+                std::cout << " " << pathLength(path.path);
+
+            //Classes from the same planner so obstacle IDs and the homotopy corridor match
+            std::vector<std::vector<voronoi_path::GraphNode>> graph_paths =
+                planner.getGraphPaths(options.start, options.goal, options.num_paths, costs[use_homotopy_search]);
+            std::cout << ", graph costs";
+            for (int j = 0; j < graph_paths.size(); ++j)
+            {
+                classes[use_homotopy_search].push_back(planners[0].calcHomotopyClass(graph_paths[j]));
+                std::cout << " " << costs[use_homotopy_search][j];
+            }
+
+            std::cout << std::endl;
+        }
+
+        bool passed = true;
+        for (int j = 0; j < classes[1].size(); ++j)
+        {
+            for (int k = j + 1; k < classes[1].size(); ++k)
+            {
+                if (classes[1][j].windings == classes[1][k].windings)
+                {
+                    std::cout << "FAIL search paths " << j << " and " << k << " are of the same class" << std::endl;
+                    passed = false;
+                }
+            }
+        }
+
+        //A class the other method found is only missed if it is cheaper than a path returned instead, or if paths are missing
+        int common = 0, longer = 0;
+        for (int method = 0; method <= 1; ++method)
+        {
+            int other = 1 - method;
+            double max_cost = costs[method].empty() ? 0 : *std::max_element(costs[method].begin(), costs[method].end());
+            for (int j = 0; j < classes[other].size(); ++j)
+            {
+                auto found = std::find_if(classes[method].begin(), classes[method].end(), [&](const voronoi_path::HomotopyClass &h_class) {
+                    return h_class.windings == classes[other][j].windings;
+                });
+
+                if (found != classes[method].end())
+                {
+                    if (method == 1)
+                    {
+                        ++common;
+                        if (costs[1][found - classes[1].begin()] > costs[0][j] + 1e-6)
+                            ++longer;
+                    }
+
+                    continue;
+                }
+
+                if (classes[method].size() < options.num_paths || max_cost > costs[other][j] + 1e-6)
+                {
+                    std::cout << "FAIL " << names[method] << " misses the class of " << names[other] << " path " << j << " of cost "
+                              << costs[other][j] << std::endl;
+                    passed = false;
+                }
+            }
+        }
+
+        std::cout << common << " classes found by both, " << longer << " of them at a higher cost by the search" << std::endl;
+
+        return passed;
+    }
+
+    /**
+     * replan while the start moves along the preferred path. Classes that replan updates incrementally must match
+     * calcHomotopyClass of the replanned paths
+     **/
+    bool benchmarkReplan(const voronoi_path::Map &base_map, const Options &options)
+    {
+        voronoi_path::Map map = base_map;
+        voronoi_path::voronoi_path planner;
+        planner.print_timings = options.print_timings;
+        planner.mapToGraph(&map);
+        std::vector<voronoi_path::Path> paths = planner.getPath(options.start, options.goal, options.num_paths);
+        if (paths.empty())
+        {
+            std::cout << "FAIL no paths found" << std::endl;
+            return false;
+        }
+
+        int pref_path = 0;
+        int checked = 0, mismatches = 0;
+        std::vector<double> replan_ms;
+        voronoi_path::GraphNode goal = options.goal;
+        for (int i = 0; i < options.repeats; ++i)
+        {
+            const std::vector<voronoi_path::GraphNode> &preferred = paths[pref_path].path;
+            voronoi_path::GraphNode start = preferred[std::min<size_t>(3, preferred.size() - 1)];
+            auto start_time = std::chrono::steady_clock::now();
+            paths = planner.replan(start, goal, options.num_paths, pref_path);
+            replan_ms.push_back(elapsedMs(start_time));
+            if (paths.empty())
+                break;
+
+            pref_path = std::min<int>(pref_path, paths.size() - 1);
+            for (const auto &path : paths)
+            {
+                if (!path.has_h_class)
+                    continue;
+
+                voronoi_path::HomotopyClass h_class = planner.calcHomotopyClass(path.path);
+                ++checked;
+                if (h_class.windings != path.h_class.windings ||
+                    std::abs(h_class.h_signature - path.h_class.h_signature) > 1e-6 * std::max(1.0, std::abs(h_class.h_signature)))
+                    ++mismatches;
+            }
+        }
+
+        std::cout << "replan " << median(replan_ms) << " ms over " << replan_ms.size() << " replans, " << checked << " classes checked, "
+                  << mismatches << " mismatches" << std::endl;
+
+        if (mismatches > 0)
+            std::cout << "FAIL classes of replanned paths differ from calcHomotopyClass" << std::endl;
+
+        return mismatches == 0;
+    }
+
+    /**
+     * getPath with use_face_classes against winding numbers. Both must return the same paths, and paths found with face
+     * classes must have distinct winding numbers
+     **/
+    bool benchmarkFaces(const voronoi_path::Map &base_map, const Options &options)
+    {
+        std::vector<voronoi_path::Path> paths[2];
+        voronoi_path::voronoi_path planners[2];
+        for (int use_face_classes = 0; use_face_classes <= 1; ++use_face_classes)
+        {
+            voronoi_path::Map map = base_map;
+            voronoi_path::voronoi_path &planner = planners[use_face_classes];
+            planner.print_timings = options.print_timings;
+            planner.use_face_classes = use_face_classes;
+
+            std::vector<double> build_ms, path_ms;
+            for (int i = 0; i < options.repeats; ++i)
+            {
+                touchMap(map, options.start);
+                auto start = std::chrono::steady_clock::now();
+                planner.mapToGraph(&map);
+                build_ms.push_back(elapsedMs(start));
+
+                planner.clearPreviousPaths();
+                start = std::chrono::steady_clock::now();
+                paths[use_face_classes] = planner.getPath(options.start, options.goal, options.num_paths);
+                path_ms.push_back(elapsedMs(start));
+            }
+
+            std::cout << (use_face_classes ? "face classes   " : "winding numbers") << " mapToGraph " << median(build_ms) << " ms, getPath "
+                      << median(path_ms) << " ms, " << paths[use_face_classes].size() << " paths" << std::endl;
+        }
+
+        bool passed = true;
+        if (paths[0].size() != paths[1].size())
+            passed = false;
+
+        for (int j = 0; j < paths[0].size() && passed; ++j)
+            passed = paths[0][j].path == paths[1][j].path;
+
+        if (!passed)
+            std::cout << "FAIL face classes and winding numbers returned different paths" << std::endl;
+
+        std::vector<voronoi_path::HomotopyClass> classes;
+        for (const auto &path : paths[1])
+            classes.push_back(planners[1].calcHomotopyClass(path.path));
+
+        for (int j = 0; j < classes.size(); ++j)
+        {
+            for (int k = j + 1; k < classes.size(); ++k)
+            {
+                if (classes[j].windings == classes[k].windings)
+                {
+                    std::cout << "FAIL face class paths " << j << " and " << k << " have the same winding numbers" << std::endl;
+                    passed = false;
+                }
+            }
+        }
+
+        return passed;
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::cout << "Usage: voronoi_path_benchmark <bitplanes|invariants|classes|search|replan|faces> [--map file.pgm] [--resolution m] "
+                     "[--obstacles n] [--start x y] [--goal x y] [--num_paths n] [--repeats n] [--seed n] [--timings]"
+                  << std::endl;
+        return 2;
+    }
+
+    Options options;
+    std::string benchmark = argv[1];
+    for (int i = 2; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--map" && has_value)
+            options.map_file = argv[++i];
+
+        else if (arg == "--timings")
+            options.print_timings = true;
+
+        else if (arg == "--resolution" && has_value)
+            options.resolution = std::atof(argv[++i]);
+
+        else if (arg == "--obstacles" && has_value)
+            options.obstacles = std::atoi(argv[++i]);
+
+        else if (arg == "--num_paths" && has_value)
+            options.num_paths = std::atoi(argv[++i]);
+
+        else if (arg == "--repeats" && has_value)
+            options.repeats = std::max(1, std::atoi(argv[++i]));
+
+        else if (arg == "--seed" && has_value)
+            options.seed = std::max(0, std::atoi(argv[++i]));
+
+        else if ((arg == "--start" || arg == "--goal") && i + 2 < argc)
+        {
+            voronoi_path::GraphNode point(std::atof(argv[i + 1]), std::atof(argv[i + 2]));
+            i += 2;
+            if (arg == "--start")
+            {
+                options.start = point;
+                options.has_start = true;
+            }
+
+            else
+            {
+                options.goal = point;
+                options.has_goal = true;
+            }
+        }
+
+        else
+        {
+            std::cout << "Unknown argument " << arg << std::endl;
+            return 2;
+        }
+    }
+
+    //Tied routes between regular shelves would hide which method misses a cheaper class
+    if (options.seed < 0)
+        options.seed = benchmark == "search" ? 1 : 0;
+
+    voronoi_path::Map map;
+    if (options.map_file.empty())
+        map = warehouseMap(options.obstacles, options.resolution, options.seed);
+
+    else if (!loadPgm(options.map_file, options.resolution, map))
+    {
+        std::cout << "Could not read " << options.map_file << ", only binary PGM images are supported" << std::endl;
+        return 2;
+    }
+
+    //Opposite corners by default
+    if (!options.has_start)
+        options.start = nearestFreeCell(map, map.width / 50, map.height / 50);
+
+    if (!options.has_goal)
+        options.goal = nearestFreeCell(map, map.width - 1 - map.width / 50, map.height - 1 - map.height / 50);
+
+    std::cout << "Map " << map.width << "x" << map.height << ", start " << options.start.x << "," << options.start.y << ", goal "
+              << options.goal.x << "," << options.goal.y << ", " << options.repeats << " repeats" << std::endl;
+
+    bool passed;
+    if (benchmark == "bitplanes")
+        passed = benchmarkBitplanes(map, options);
+
+    else if (benchmark == "invariants")
+        passed = benchmarkInvariants(map, options);
+
+    else if (benchmark == "classes")
+        passed = benchmarkClasses(map, options);
+
+    else if (benchmark == "search")
+        passed = benchmarkSearch(map, options);
+
+    else if (benchmark == "replan")
+        passed = benchmarkReplan(map, options);
+
+    else if (benchmark == "faces")
+        passed = benchmarkFaces(map, options);
+
+    else
+    {
+        std::cout << "Unknown benchmark " << benchmark << std::endl;
+        return 2;
+    }
+
+    return passed ? 0 : 1;
+}